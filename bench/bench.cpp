@@ -0,0 +1,232 @@
+// Host benchmarks for the release parsers and the download write path.
+//
+//   nrl-bench [-o DIR] [recorded.json...]
+//
+// Without files, synthetic GitLab /releases pages of several sizes are
+// parsed; recorded responses given on the command line are replayed as
+// they are. The writer benchmark streams bytes through the DiskPipeline
+// into a scratch file in DIR (default /tmp).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jansson.h>
+
+#include "releases.h"
+#include "sha256.h"
+#include "writer.h"
+
+// -------------------- Allocation Counting --------------------
+
+static std::atomic<unsigned long> allocations{0};
+
+void* operator new(size_t n) {
+  ++allocations;
+  void* p = malloc(n ? n : 1);
+  if (!p)
+    abort();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// jansson allocates with malloc unless told otherwise.
+static void* countedMalloc(size_t n) {
+  ++allocations;
+  return malloc(n);
+}
+
+// -------------------- Harness --------------------
+
+using Clock = std::chrono::steady_clock;
+
+// Bytes fed to each call, for streaming parsers.
+static const size_t kChunk = 16 * 1024;
+// Each benchmark repeats until it has run at least this long.
+static const double kMinSeconds = 0.5;
+
+// Runs `fn` repeatedly and prints ns/op, allocations/op and MB/s over
+// `bytes` per op.
+static void measure(const std::string& name, size_t bytes,
+                    const std::function<bool()>& fn) {
+  if (!fn()) { // warm-up, and a check the input is accepted at all
+    printf("%-40s  FAILED\n", name.c_str());
+    return;
+  }
+  unsigned long ops = 0;
+  unsigned long allocs = allocations;
+  Clock::time_point start = Clock::now();
+  double seconds = 0;
+  do {
+    fn();
+    ++ops;
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (seconds < kMinSeconds);
+  allocs = allocations - allocs;
+
+  printf("%-40s %12.0f ns/op %10.1f allocs/op %9.1f MB/s\n", name.c_str(),
+         seconds * 1e9 / ops, (double)allocs / ops,
+         bytes * ops / seconds / (1024.0 * 1024.0));
+}
+
+// -------------------- Release Parsers --------------------
+
+// One page shaped like GitLab's /projects/:id/releases answer.
+static std::string syntheticReleases(int count) {
+  std::string json = "[";
+  char buf[2048];
+  for (int i = 0; i < count; ++i) {
+    snprintf(buf, sizeof(buf),
+             "%s{\"name\":\"Release 1.%d\",\"tag_name\":\"v1.%d\","
+             "\"description\":\"## Changes\\n\\n* Fixed crash \\\"%d\\\" "
+             "when loading \\u00e9l\\u00e9ments\\n* Faster startup\\n\","
+             "\"created_at\":\"2024-03-%02dT12:00:00.000Z\","
+             "\"released_at\":\"2024-03-%02dT12:00:00.000Z\","
+             "\"author\":{\"id\":1,\"username\":\"dev\",\"name\":\"Dev\","
+             "\"state\":\"active\",\"avatar_url\":null},"
+             "\"commit\":{\"id\":\"%040d\",\"short_id\":\"%08d\","
+             "\"title\":\"Bump version\",\"message\":\"Bump version\\n\","
+             "\"parent_ids\":[\"%040d\"]},\"upcoming_release\":false,"
+             "\"assets\":{\"count\":3,\"sources\":["
+             "{\"format\":\"zip\",\"url\":\"https://gitlab.example.com/g/p/"
+             "-/archive/v1.%d/p-v1.%d.zip\"},"
+             "{\"format\":\"tar.gz\",\"url\":\"https://gitlab.example.com/g/"
+             "p/-/archive/v1.%d/p-v1.%d.tar.gz\"}],"
+             "\"links\":[{\"id\":%d,\"name\":\"NRO-Launcher.nro\","
+             "\"url\":\"https://gitlab.example.com/g/p/-/jobs/%d/artifacts/"
+             "raw/NRO-Launcher.nro\",\"direct_asset_url\":\"https://"
+             "gitlab.example.com/g/p/-/releases/v1.%d/downloads/"
+             "NRO-Launcher.nro\",\"link_type\":\"package\"}]},"
+             "\"_links\":{\"self\":\"https://gitlab.example.com/g/p/-/"
+             "releases/v1.%d\"}}",
+             i ? "," : "", count - i, count - i, i, i % 28 + 1, i % 28 + 1, i,
+             i, i, count - i, count - i, count - i, count - i, i, 1000 + i,
+             count - i, count - i);
+    json += buf;
+  }
+  json += "]";
+  return json;
+}
+
+static bool readFile(const char* path, std::string& out) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp)
+    return false;
+  char buf[64 * 1024];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    out.append(buf, n);
+  bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+}
+
+static void benchParsers(const std::string& label, const std::string& json) {
+  measure("parseReleases " + label, json.size(), [&]() {
+    return !parseReleases(json).releases.empty();
+  });
+
+  measure("ReleaseStreamParser " + label, json.size(), [&]() {
+    ReleaseStreamParser parser;
+    for (size_t at = 0; at < json.size(); at += kChunk)
+      parser.feed(json.data() + at, std::min(kChunk, json.size() - at));
+    ReleaseList list;
+    return parser.finish(list) && !list.releases.empty();
+  });
+
+  // Opening a release: its detail is parsed from the kept object text.
+  ReleaseList list = parseReleases(json);
+  if (list.releases.empty() || list.releases[0].detailJson.empty())
+    return;
+  std::string_view detail = list.releases[0].detailJson;
+  measure("parseReleaseDetail " + label, detail.size(), [&]() {
+    Arena arena;
+    ReleaseDetail out;
+    return parseReleaseDetail(detail, arena, out);
+  });
+}
+
+// -------------------- Write Path --------------------
+
+static void benchWriter(const std::string& dir) {
+  const size_t total = 64 * 1024 * 1024;
+  std::string path = dir + "/nrl-bench.bin";
+  std::vector<char> chunk(kChunk);
+  for (size_t i = 0; i < chunk.size(); ++i)
+    chunk[i] = (char)(i * 131);
+
+  // The network callback's job: hand bytes to the writer, waiting whenever
+  // the pool is out of buffers, and hash what it took.
+  auto stream = [&](bool hash) {
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+      return false;
+    fclose(fp);
+    AlignedWriter writer(DiskPipeline::get());
+    if (!writer.open(path, 0))
+      return false;
+    Sha256Context sha;
+    sha256ContextCreate(&sha);
+    for (size_t done = 0; done < total; done += chunk.size()) {
+      WriteResult r;
+      while ((r = writer.write(chunk.data(), chunk.size())) ==
+             WriteResult::Full)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      if (r == WriteResult::Error)
+        return false;
+      if (hash)
+        sha256ContextUpdate(&sha, chunk.data(), chunk.size());
+    }
+    return writer.close();
+  };
+
+  measure("AlignedWriter 64 MB", total, [&]() { return stream(false); });
+  measure("AlignedWriter+SHA-256 64 MB", total, [&]() { return stream(true); });
+  remove(path.c_str());
+
+  LatencyHistogram::Counts c = DiskPipeline::get().writeLatency().snapshot();
+  printf("  disk writes: %u, p50 %d ms, p99 %d ms\n", c.total(),
+         c.percentileMs(0.5), c.percentileMs(0.99));
+}
+
+// -------------------- Main --------------------
+
+int main(int argc, char** argv) {
+  std::string dir = "/tmp";
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      dir = argv[++i];
+    else
+      files.push_back(argv[i]);
+  }
+
+  json_set_alloc_funcs(countedMalloc, free);
+
+  if (files.empty()) {
+    for (int count : {1, 20, 100, 1000})
+      benchParsers(std::to_string(count) + " releases",
+                   syntheticReleases(count));
+  }
+  for (const char* file : files) {
+    std::string json;
+    if (!readFile(file, json)) {
+      fprintf(stderr, "Cannot read %s\n", file);
+      return 1;
+    }
+    benchParsers(file, json);
+  }
+
+  benchWriter(dir);
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+
+#include "applet.h"
+
+// -------------------- Applet Hooks --------------------
+
+AppletMonitor::AppletMonitor(std::function<void()> suspend,
+                             std::function<void()> resume,
+                             std::function<void()> restart)
+    : suspend(std::move(suspend)), resume(std::move(resume)),
+      restart(std::move(restart)) {
+  AppletType type = appletGetAppletType();
+  if (type == AppletType_Application || type == AppletType_SystemApplication) {
+    Result rc = appletSetFocusHandlingMode(AppletFocusHandlingMode_NoSuspend);
+    if (R_SUCCEEDED(rc))
+      keepsRunning = true;
+    else
+      std::cerr << "Failed to set focus handling mode: 0x" << std::hex << rc
+                << std::dec << "\n";
+  }
+  appletHook(&cookie, hookCallback, this);
+}
+
+AppletMonitor::~AppletMonitor() {
+  appletUnhook(&cookie);
+  keepAwake(false);
+}
+
+void AppletMonitor::keepAwake(bool on) {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (on == awake)
+    return;
+  Result rc = appletSetAutoSleepDisabled(on);
+  if (R_FAILED(rc)) {
+    std::cerr << "Failed to " << (on ? "disable" : "enable")
+              << " auto-sleep: 0x" << std::hex << rc << std::dec << "\n";
+    return;
+  }
+  awake = on;
+}
+
+void AppletMonitor::hookCallback(AppletHookType type, void* param) {
+  auto* self = static_cast<AppletMonitor*>(param);
+  if (type == AppletHookType_OnFocusState)
+    self->focusChanged();
+  else if (type == AppletHookType_OnResume)
+    self->wokeUp();
+}
+
+void AppletMonitor::focusChanged() {
+  if (keepsRunning)
+    return;
+  bool inFocus = appletGetFocusState() == AppletFocusState_InFocus;
+  // Stop while the journals can still be written; the system freezes the
+  // process shortly after.
+  if (!inFocus && !suspended) {
+    suspended = true;
+    suspend();
+  } else if (inFocus && suspended) {
+    suspended = false;
+    resume();
+  }
+}
+
+void AppletMonitor::wokeUp() {
+  // Sleep dropped the connections; the transfers would otherwise only
+  // notice once the low-speed limit runs out. Still out of focus, they
+  // start again once focus is back.
+  if (suspended)
+    return;
+  restart();
+}
@@ -0,0 +1,51 @@
+#ifndef APPLET_H
+#define APPLET_H
+
+#include <switch.h>
+
+#include <functional>
+#include <mutex>
+
+// -------------------- Applet Hooks --------------------
+
+// Keeps downloads going through Home, focus changes and the screen going
+// dark. Run as an application, the app asks not to be suspended when it
+// loses focus, so transfers carry on behind the Home menu. While
+// keepAwake() is set the console does not fall asleep on its own; the
+// screen still dims, which costs nothing to the transfers.
+//
+// What cannot be kept alive is reported instead: as a library applet the
+// app is suspended out of focus, and every connection is gone after the
+// console wakes up. `suspend` and `resume` run on the UI thread, from
+// inside appletMainLoop(), around those; `restart` after a wake-up, to
+// reconnect transfers whose connections are gone.
+class AppletMonitor {
+public:
+  AppletMonitor(std::function<void()> suspend, std::function<void()> resume,
+                std::function<void()> restart);
+  ~AppletMonitor();
+
+  AppletMonitor(const AppletMonitor&) = delete;
+  AppletMonitor& operator=(const AppletMonitor&) = delete;
+
+  // Holds off auto-sleep while `awake`; may be called from any thread.
+  void keepAwake(bool awake);
+
+private:
+  static void hookCallback(AppletHookType type, void* param);
+  void focusChanged();
+  void wokeUp();
+
+  std::function<void()> suspend;
+  std::function<void()> resume;
+  std::function<void()> restart;
+  AppletHookCookie cookie;
+  // An application that keeps running while out of focus.
+  bool keepsRunning = false;
+  bool suspended = false;
+
+  std::mutex mtx;
+  bool awake = false;
+};
+
+#endif // APPLET_H
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <iostream>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "cache.h"
+#include "snapshot.h"
+
+const char* const kAppDataDir = "sdmc:/switch/NRO-Launcher";
+
+void ensureAppDataDirectory() {
+  if (mkdir("sdmc:/switch", 0777) != 0 && errno != EEXIST) {
+    std::cerr << "Error creating sdmc:/switch: " << errno << "\n";
+  }
+  if (mkdir(kAppDataDir, 0777) != 0 && errno != EEXIST) {
+    std::cerr << "Error creating " << kAppDataDir << ": " << errno << "\n";
+  }
+}
+
+// -------------------- Load / Save --------------------
+
+bool loadReleaseCache(const std::string& path, const std::string& apiUrl,
+                      ReleaseList& releases, std::string& etag) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || st.st_size <= 0)
+    return false;
+
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  size_t size = st.st_size;
+  std::unique_ptr<char[]> blob(new char[size]);
+  bool ok = fread(blob.get(), 1, size, fp) == size;
+  fclose(fp);
+  if (!ok)
+    return false;
+
+  ReleaseList loaded;
+  std::string_view cachedUrl, cachedEtag;
+  if (!decodeSnapshot(std::move(blob), size, loaded, cachedUrl, cachedEtag) ||
+      cachedUrl != apiUrl)
+    return false;
+
+  etag.assign(cachedEtag);
+  releases = std::move(loaded);
+  return true;
+}
+
+bool saveReleaseCache(const std::string& path, const std::string& apiUrl,
+                      const std::vector<Release>& releases,
+                      const std::string& etag) {
+  std::string out = encodeSnapshot(releases, apiUrl, etag);
+
+  ensureAppDataDirectory();
+  std::string tmp = path + ".tmp";
+  FILE* fp = fopen(tmp.c_str(), "wb");
+  if (!fp) {
+    std::cerr << "Failed to open " << tmp << "\n";
+    return false;
+  }
+  bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) {
+    remove(tmp.c_str());
+    return false;
+  }
+
+  // FAT rename does not replace an existing file.
+  remove(path.c_str());
+  return rename(tmp.c_str(), path.c_str()) == 0;
+}
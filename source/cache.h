@@ -0,0 +1,29 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "model.h"
+
+// -------------------- Release Metadata Cache --------------------
+
+// Directory holding the launcher's own persistent state.
+extern const char* const kAppDataDir;
+
+// Creates kAppDataDir (and its parent) when missing.
+void ensureAppDataDirectory();
+
+// Loads the releases last fetched from `apiUrl` together with the ETag the
+// server sent for them. Returns false when there is no usable cache, e.g. it
+// is missing, truncated, from another format version or for another URL.
+// The file is a release snapshot (see snapshot.h) read with a single fread.
+bool loadReleaseCache(const std::string& path, const std::string& apiUrl,
+                      ReleaseList& releases, std::string& etag);
+
+// Replaces the cache atomically (write to a temporary file, then rename).
+bool saveReleaseCache(const std::string& path, const std::string& apiUrl,
+                      const std::vector<Release>& releases,
+                      const std::string& etag);
+
+#endif // CACHE_H
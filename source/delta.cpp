@@ -0,0 +1,298 @@
+#include <bzlib.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+
+#include "delta.h"
+#include "net.h"
+#include "sha256.h"
+#include "store.h"
+
+static const size_t kPatchChunk = 64 * 1024;
+static const size_t kOutputBuffer = 1024 * 1024;
+static const size_t kHeaderSize = 32;
+
+// -------------------- Checksum Lists --------------------
+
+static std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    s.remove_prefix(1);
+  while (!s.empty() &&
+         (s.back() == ' ' || s.back() == '\t' || s.back() == '\r'))
+    s.remove_suffix(1);
+  return s;
+}
+
+static std::string lowercase(std::string_view s) {
+  std::string out(s);
+  for (char& c : out) {
+    if (c >= 'A' && c <= 'F')
+      c += 'a' - 'A';
+  }
+  return out;
+}
+
+std::string findChecksum(std::string_view text, std::string_view name) {
+  std::string_view bare;
+  int entries = 0;
+  while (!text.empty()) {
+    size_t nl = text.find('\n');
+    std::string_view line = trim(text.substr(0, nl));
+    text = nl == std::string_view::npos ? std::string_view()
+                                        : text.substr(nl + 1);
+    if (line.empty())
+      continue;
+    ++entries;
+
+    size_t sp = line.find_first_of(" \t");
+    std::string_view hash = line.substr(0, sp);
+    if (hash.size() != 64)
+      continue;
+    if (sp == std::string_view::npos) {
+      bare = hash;
+      continue;
+    }
+    std::string_view file = trim(line.substr(sp));
+    if (!file.empty() && file.front() == '*')
+      file.remove_prefix(1);
+    // Lists made in a build tree may carry directories.
+    size_t slash = file.find_last_of('/');
+    if (slash != std::string_view::npos)
+      file.remove_prefix(slash + 1);
+    if (file == name)
+      return lowercase(hash);
+  }
+  if (entries == 1 && !bare.empty())
+    return lowercase(bare);
+  return {};
+}
+
+bool fetchText(const std::string& url, const std::string& token,
+               std::string& out) {
+  CurlEasy curl;
+  MemoryBuffer buffer;
+  struct curl_slist* headers = nullptr;
+  if (!token.empty())
+    headers = curl_slist_append(headers, ("PRIVATE-TOKEN: " + token).c_str());
+  curl.setopt(CURLOPT_FAILONERROR, 1L);
+  curl.acceptCompressed();
+  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEFUNCTION,
+                   MemoryBuffer::WriteCallback);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEDATA, &buffer);
+  // Redirects are followed here so the token stays on its own host.
+  std::string at = url;
+  CURLcode res;
+  for (int hops = 0;; ++hops) {
+    curl.setopt(CURLOPT_URL, at.c_str());
+    curl.setopt(CURLOPT_HTTPHEADER,
+                urlHost(at) == urlHost(url) ? headers : nullptr);
+    buffer.data.clear();
+    res = curl_easy_perform(curl.getHandle());
+    std::string next =
+        res == CURLE_OK ? redirectTarget(curl.getHandle()) : std::string();
+    if (next.empty())
+      break;
+    if (hops == kMaxRedirects) {
+      res = CURLE_TOO_MANY_REDIRECTS;
+      break;
+    }
+    at = next;
+  }
+  curl_slist_free_all(headers);
+  if (res != CURLE_OK) {
+    std::cerr << "CURL error (" << url << "): " << curl_easy_strerror(res)
+              << "\n";
+    return false;
+  }
+  out.swap(buffer.data);
+  return true;
+}
+
+// -------------------- bspatch --------------------
+
+// BSDIFF40 stores integers as sign and magnitude, little endian.
+static int64_t offtin(const unsigned char* b) {
+  int64_t y = b[7] & 0x7F;
+  for (int i = 6; i >= 0; --i)
+    y = y * 256 + b[i];
+  return b[7] & 0x80 ? -y : y;
+}
+
+// One of the patch's three bzip2 blocks, read from its own file handle.
+class BzBlock {
+public:
+  ~BzBlock() {
+    int err;
+    if (bz)
+      BZ2_bzReadClose(&err, bz);
+    if (fp)
+      fclose(fp);
+  }
+
+  bool open(const std::string& path, long long offset) {
+    fp = fopen(path.c_str(), "rb");
+    if (!fp || fseeko(fp, offset, SEEK_SET) != 0)
+      return false;
+    int err;
+    bz = BZ2_bzReadOpen(&err, fp, 0, 0, nullptr, 0);
+    return err == BZ_OK;
+  }
+
+  // Exactly `n` bytes or failure.
+  bool read(void* buf, size_t n) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+      int err;
+      int got = BZ2_bzRead(&err, bz, p, n);
+      if ((err != BZ_OK && err != BZ_STREAM_END) || got <= 0)
+        return false;
+      p += got;
+      n -= got;
+      if (err == BZ_STREAM_END && n > 0)
+        return false;
+    }
+    return true;
+  }
+
+private:
+  FILE* fp = nullptr;
+  BZFILE* bz = nullptr;
+};
+
+std::string applyBsdiff(const std::string& basePath,
+                        const std::string& patchPath,
+                        const std::string& outPath,
+                        const std::atomic<bool>& canceled,
+                        std::atomic<curl_off_t>& done,
+                        std::atomic<curl_off_t>& total) {
+  unsigned char header[kHeaderSize];
+  FILE* pf = fopen(patchPath.c_str(), "rb");
+  bool read = pf && fread(header, 1, kHeaderSize, pf) == kHeaderSize;
+  if (pf)
+    fclose(pf);
+  if (!read || memcmp(header, "BSDIFF40", 8) != 0) {
+    std::cerr << patchPath << " is not a BSDIFF40 patch\n";
+    return {};
+  }
+  int64_t ctrlLen = offtin(header + 8);
+  int64_t diffLen = offtin(header + 16);
+  int64_t newSize = offtin(header + 24);
+  if (ctrlLen < 0 || diffLen < 0 || newSize < 0)
+    return {};
+
+  BzBlock ctrl, diff, extra;
+  if (!ctrl.open(patchPath, kHeaderSize) ||
+      !diff.open(patchPath, kHeaderSize + ctrlLen) ||
+      !extra.open(patchPath, kHeaderSize + ctrlLen + diffLen)) {
+    std::cerr << "Failed to open " << patchPath << "\n";
+    return {};
+  }
+
+  struct stat st;
+  FILE* base = fopen(basePath.c_str(), "rb");
+  if (!base || fstat(fileno(base), &st) != 0) {
+    std::cerr << "Failed to open " << basePath << "\n";
+    if (base)
+      fclose(base);
+    return {};
+  }
+  int64_t baseSize = st.st_size;
+
+  FILE* out = fopen(outPath.c_str(), "wb");
+  if (!out) {
+    std::cerr << "Failed to open " << outPath << "\n";
+    fclose(base);
+    return {};
+  }
+  // Output goes straight out in large sequential writes.
+  std::unique_ptr<char[]> outBuf(new char[kOutputBuffer]);
+  setvbuf(out, outBuf.get(), _IOFBF, kOutputBuffer);
+
+  Sha256Context sha;
+  sha256ContextCreate(&sha);
+  total = newSize;
+  done = 0;
+
+  std::unique_ptr<unsigned char[]> a(new unsigned char[kPatchChunk]);
+  std::unique_ptr<unsigned char[]> b(new unsigned char[kPatchChunk]);
+  int64_t oldPos = 0;
+  int64_t newPos = 0;
+  int64_t basePos = 0; // where `base` is positioned
+  bool ok = true;
+
+  auto emit = [&](const unsigned char* p, size_t n) {
+    sha256ContextUpdate(&sha, p, n);
+    ok = ok && fwrite(p, 1, n, out) == n;
+    newPos += n;
+    done = newPos;
+  };
+
+  while (ok && newPos < newSize) {
+    if (canceled) {
+      ok = false;
+      break;
+    }
+    unsigned char c[24];
+    if (!ctrl.read(c, sizeof(c))) {
+      ok = false;
+      break;
+    }
+    int64_t add = offtin(c);
+    int64_t copy = offtin(c + 8);
+    int64_t seek = offtin(c + 16);
+    if (add < 0 || copy < 0 || newPos + add + copy > newSize) {
+      ok = false;
+      break;
+    }
+
+    // Diff bytes are added to the base at oldPos; base bytes outside the
+    // file count as zero.
+    while (ok && add > 0) {
+      size_t n = add < (int64_t)kPatchChunk ? add : kPatchChunk;
+      if (!diff.read(a.get(), n)) {
+        ok = false;
+        break;
+      }
+      memset(b.get(), 0, n);
+      int64_t from = oldPos < 0 ? 0 : oldPos;
+      int64_t to = oldPos + (int64_t)n < baseSize ? oldPos + n : baseSize;
+      if (from < to) {
+        if (from != basePos && fseeko(base, from, SEEK_SET) != 0)
+          ok = false;
+        ok = ok && fread(b.get() + (from - oldPos), 1, to - from, base) ==
+                       (size_t)(to - from);
+        basePos = to;
+      }
+      for (size_t i = 0; i < n; ++i)
+        a[i] += b[i];
+      emit(a.get(), n);
+      oldPos += n;
+      add -= n;
+    }
+
+    while (ok && copy > 0) {
+      size_t n = copy < (int64_t)kPatchChunk ? copy : kPatchChunk;
+      if (!extra.read(a.get(), n)) {
+        ok = false;
+        break;
+      }
+      emit(a.get(), n);
+      copy -= n;
+    }
+    oldPos += seek;
+  }
+
+  fclose(base);
+  ok = fclose(out) == 0 && ok;
+  if (!ok) {
+    if (!canceled)
+      std::cerr << "Applying " << patchPath << " failed\n";
+    remove(outPath.c_str());
+    return {};
+  }
+  return digestHex(sha);
+}
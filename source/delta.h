@@ -0,0 +1,46 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+
+// -------------------- Binary Delta Updates --------------------
+
+// A release can ship "<asset>@<older tag>.bsdiff" (classic BSDIFF40, as the
+// bsdiff tool writes it) next to the full asset, together with a checksum
+// for the result: "<asset>.sha256" or a SHA256SUMS list. When the store
+// still holds the asset from that older tag, downloading the patch and
+// applying it locally replaces the full download.
+struct DeltaPlan {
+  std::string patchUrl;
+  std::string basePath;    // the older release's copy, in the store
+  std::string checksumUrl; // sha256sum-format text listing the result
+  std::string checksumName; // file name to look up in that list
+
+  bool empty() const { return patchUrl.empty(); }
+};
+
+// The hash listed for `name` in sha256sum-format text ("<hex>  <name>" per
+// line, optionally with '*' before the name); a file holding a single bare
+// hash matches any name. Empty when not listed.
+std::string findChecksum(std::string_view text, std::string_view name);
+
+// Downloads a small text resource such as a checksum list.
+bool fetchText(const std::string& url, const std::string& token,
+               std::string& out);
+
+// Writes `outPath` from `basePath` and the BSDIFF40 patch at `patchPath`,
+// hashing the result as it is written. Returns its lowercase hex SHA-256,
+// or empty on failure or once `canceled` is set. `done`/`total` track the
+// bytes written.
+std::string applyBsdiff(const std::string& basePath,
+                        const std::string& patchPath,
+                        const std::string& outPath,
+                        const std::atomic<bool>& canceled,
+                        std::atomic<curl_off_t>& done,
+                        std::atomic<curl_off_t>& total);
+
+#endif // DELTA_H
@@ -0,0 +1,193 @@
+#include <curl/curl.h>
+
+#include <iostream>
+
+#include "details.h"
+#include "frames.h"
+#include "net.h"
+#include "platform.h"
+
+// -------------------- Release Details --------------------
+
+static std::string detailKey(unsigned source, std::string_view tag) {
+  return std::to_string(source) + "/" + std::string(tag);
+}
+
+ReleaseDetails::ReleaseDetails(std::vector<Source> sources)
+    : sources(std::move(sources)) {}
+
+ReleaseDetails::~ReleaseDetails() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  cv.notify_all();
+  if (worker.joinable())
+    worker.join();
+}
+
+void ReleaseDetails::start() {
+  worker = std::thread([this]() { run(); });
+}
+
+const ReleaseDetail* ReleaseDetails::get(const Release& r) {
+  std::lock_guard<std::mutex> lock(mtx);
+  auto it = loaded.find(detailKey(r.source, r.tag));
+  if (it != loaded.end())
+    return it->second;
+  if (r.detailJson.empty()) {
+    queueLocked(r, true);
+    return nullptr;
+  }
+  // Parsing one object takes microseconds; not worth a round trip to the
+  // worker while the user waits for the screen.
+  return addLocked(r.source, r.tag, r.detailJson);
+}
+
+void ReleaseDetails::prefetch(const std::vector<Release>& releases, int index,
+                              int radius) {
+  int n = releases.size();
+  if (n == 0)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    // Nearest first, alternating forwards and backwards.
+    for (int d = 1; d <= radius && d < n; ++d) {
+      queueLocked(releases[(index + d) % n], false);
+      queueLocked(releases[(index - d + n) % n], false);
+    }
+  }
+  cv.notify_one();
+}
+
+void ReleaseDetails::clear() {
+  std::lock_guard<std::mutex> lock(mtx);
+  loaded.clear();
+  queue.clear();
+  arena.reset();
+  ++epoch;
+}
+
+bool ReleaseDetails::isLoadedLocked(unsigned source, std::string_view tag) {
+  return loaded.find(detailKey(source, tag)) != loaded.end();
+}
+
+void ReleaseDetails::queueLocked(const Release& r, bool urgent) {
+  if (isLoadedLocked(r.source, r.tag))
+    return;
+  for (auto& p : queue) {
+    if (p.source == r.source && p.tag == r.tag)
+      return;
+  }
+  Pending p{r.source, std::string(r.tag), std::string(r.detailJson)};
+  if (urgent) {
+    queue.push_front(std::move(p));
+    cv.notify_one();
+  } else {
+    queue.push_back(std::move(p));
+  }
+}
+
+const ReleaseDetail* ReleaseDetails::addLocked(unsigned source,
+                                               std::string_view tag,
+                                               std::string_view json) {
+  ReleaseDetail* detail = arena.allocate<ReleaseDetail>(1);
+  *detail = ReleaseDetail();
+  if (json.empty() || source >= sources.size() ||
+      !sources[source].adapter().parseDetail(json, arena, *detail))
+    detail->description = "(Details could not be loaded.)";
+  loaded.emplace(arena.add(detailKey(source, tag)), detail);
+  return detail;
+}
+
+bool ReleaseDetails::fetch(const Source& source, const std::string& tag,
+                           std::string& body) {
+  std::string url = source.adapter().releaseUrl(source.apiUrl, tag);
+
+  CurlEasy curl;
+  MemoryBuffer buffer;
+  struct curl_slist* headers = source.adapter().apiHeaders(source.token);
+  // Without the token, for redirects away from the API host.
+  struct curl_slist* foreign = source.adapter().apiHeaders(std::string());
+  curl.setopt(CURLOPT_FAILONERROR, 1L);
+  curl.preferHttp2();
+  curl.acceptCompressed();
+  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEFUNCTION,
+                   MemoryBuffer::WriteCallback);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEDATA, &buffer);
+  CURLcode res;
+  for (int attempt = 1;; ++attempt) {
+    // Redirects are followed here so the token stays on its own host.
+    std::string at = url;
+    for (int hops = 0;; ++hops) {
+      curl.setopt(CURLOPT_URL, at.c_str());
+      curl.setopt(CURLOPT_HTTPHEADER,
+                  urlHost(at) == urlHost(url) ? headers : foreign);
+      buffer.data.clear();
+      res = curl_easy_perform(curl.getHandle());
+      std::string next =
+          res == CURLE_OK ? redirectTarget(curl.getHandle()) : std::string();
+      if (next.empty())
+        break;
+      if (hops == kMaxRedirects) {
+        res = CURLE_TOO_MANY_REDIRECTS;
+        break;
+      }
+      at = next;
+    }
+    if (res == CURLE_OK || attempt >= kTransferPolicy.maxAttempts ||
+        !isRetryableFailure(res, curl.getResponseCode()))
+      break;
+    std::chrono::milliseconds delay = retryDelay(attempt, kTransferPolicy);
+    std::cerr << "Retrying release " << tag << " in " << delay.count()
+              << " ms (" << curl_easy_strerror(res) << ")\n";
+    std::unique_lock<std::mutex> lock(mtx);
+    if (cv.wait_for(lock, delay, [this]() { return stopping; }))
+      break;
+  }
+  curl_slist_free_all(headers);
+  curl_slist_free_all(foreign);
+
+  if (res != CURLE_OK) {
+    std::cerr << "CURL error (release " << tag
+              << "): " << curl_easy_strerror(res) << "\n";
+    return false;
+  }
+  body.swap(buffer.data);
+  return true;
+}
+
+void ReleaseDetails::run() {
+  pinCurrentThreadToCore(kNetworkCore);
+  for (;;) {
+    Pending next;
+    unsigned startEpoch;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+      if (stopping)
+        return;
+      next = std::move(queue.front());
+      queue.pop_front();
+      if (isLoadedLocked(next.source, next.tag))
+        continue;
+      startEpoch = epoch;
+    }
+
+    // Only the network wait happens outside the lock.
+    std::string body;
+    if (next.json.empty() && next.source < sources.size())
+      fetch(sources[next.source], next.tag, body);
+    else
+      body.swap(next.json);
+
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      // Results for a list that has since been replaced are dropped.
+      if (epoch == startEpoch && !isLoadedLocked(next.source, next.tag))
+        addLocked(next.source, next.tag, body);
+    }
+    ++loadedCount;
+    FrameScheduler::get().notify();
+  }
+}
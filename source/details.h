@@ -0,0 +1,74 @@
+#ifndef DETAILS_H
+#define DETAILS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "model.h"
+#include "sources.h"
+
+// -------------------- Release Details --------------------
+
+// Turns list entries into ReleaseDetails on first use and keeps them by
+// source and tag, parsed by the source's forge adapter. An entry that
+// carries its JSON is parsed on the spot; one without is fetched from its
+// source on a background thread, during which get() returns nullptr. prefetch() hands the neighbours of the shown release to
+// the same thread so scrolling finds their details ready.
+class ReleaseDetails {
+public:
+  explicit ReleaseDetails(std::vector<Source> sources);
+  ~ReleaseDetails();
+
+  ReleaseDetails(const ReleaseDetails&) = delete;
+  ReleaseDetails& operator=(const ReleaseDetails&) = delete;
+
+  void start();
+
+  // The returned detail stays valid until clear().
+  const ReleaseDetail* get(const Release& r);
+  void prefetch(const std::vector<Release>& releases, int index, int radius);
+
+  // Drops everything, freeing the whole arena at once; call when the
+  // release list is replaced.
+  void clear();
+
+  // Changes whenever the background thread finishes an entry.
+  unsigned generation() const { return loadedCount; }
+
+private:
+  struct Pending {
+    unsigned source = 0;
+    std::string tag;
+    std::string json; // copied so the list may change meanwhile
+  };
+
+  void run();
+  bool fetch(const Source& source, const std::string& tag, std::string& body);
+  const ReleaseDetail* addLocked(unsigned source, std::string_view tag,
+                                 std::string_view json);
+  void queueLocked(const Release& r, bool urgent);
+  bool isLoadedLocked(unsigned source, std::string_view tag);
+
+  std::vector<Source> sources;
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  // Details, their strings and the map keys ("<source>/<tag>") all live in
+  // `arena`.
+  Arena arena;
+  std::unordered_map<std::string_view, const ReleaseDetail*> loaded;
+  std::deque<Pending> queue;
+  unsigned epoch = 0;
+  bool stopping = false;
+  std::atomic<unsigned> loadedCount{0};
+  std::thread worker;
+};
+
+#endif // DETAILS_H
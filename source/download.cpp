@@ -0,0 +1,761 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "download.h"
+#include "store.h"
+
+// Files smaller than this are not worth the extra connections.
+static const curl_off_t kMinSegmentedSize = 8 * 1024 * 1024;
+static const curl_off_t kMinSegmentSize = 4 * 1024 * 1024;
+static const int kMaxSegments = 4;
+// Segment boundaries fall on this multiple so every segment starts aligned.
+static const curl_off_t kSegmentAlign = 1024 * 1024;
+
+// -------------------- Download Helpers --------------------
+
+static std::string urlEncodeProject(const std::string& path) {
+  std::string out;
+  for (char c : path) {
+    if (c == '/')
+      out += "%2F";
+    else
+      out += c;
+  }
+  return out;
+}
+
+std::string fatSafeName(std::string_view s) {
+  std::string out(s);
+  for (char& c : out) {
+    if (std::string_view("\\/:*?\"<>|\t").find(c) != std::string_view::npos)
+      c = '_';
+  }
+  return out;
+}
+
+std::string downloadFileName(const Asset& a) {
+  std::string filename(a.url.substr(a.url.find_last_of('/') + 1));
+  if (filename.empty())
+    filename.assign(a.name);
+  size_t qm = filename.find('?');
+  if (qm != std::string::npos)
+    filename.resize(qm);
+  return fatSafeName(filename);
+}
+
+bool isArtifactArchive(const Asset& a) {
+  std::string_view url = a.url.substr(0, a.url.find('?'));
+  auto endsWith = [&](std::string_view suffix) {
+    return url.size() >= suffix.size() &&
+           url.substr(url.size() - suffix.size()) == suffix;
+  };
+  // /-/jobs/<id>/artifacts/download, its API form /jobs/<id>/artifacts and
+  // /-/jobs/artifacts/<ref>/download?job=<name> serve a job's whole
+  // archive. Any other zip, such as the release's "Source (zip)", is an
+  // asset like the rest.
+  if (url.find("/jobs/") == std::string_view::npos)
+    return false;
+  return endsWith("/artifacts/download") || endsWith("/artifacts") ||
+         (url.find("/jobs/artifacts/") != std::string_view::npos &&
+          endsWith("/download"));
+}
+
+std::string resolveArtifactUrl(const std::string& input) {
+  std::string url = input;
+  size_t jobs = url.find("/-/jobs/");
+  if (jobs != std::string::npos) {
+    size_t scheme_end = url.find("//") + 2;
+    size_t domain_end = url.find('/', scheme_end);
+    if (domain_end != std::string::npos && domain_end < jobs) {
+      std::string domain = url.substr(0, domain_end);
+      std::string project = url.substr(domain_end + 1, jobs - domain_end - 1);
+      size_t id_start = jobs + strlen("/-/jobs/");
+      size_t id_end = url.find('/', id_start);
+      std::string jobId = url.substr(id_start, id_end - id_start);
+      size_t art = url.find("/artifacts/", id_end);
+      if (art != std::string::npos) {
+        std::string rest = url.substr(art + strlen("/artifacts/"));
+        const std::string rawPrefix = "raw/";
+        if (rest.rfind(rawPrefix, 0) == 0)
+          rest = rest.substr(rawPrefix.size());
+        url = domain + "/api/v4/projects/" + urlEncodeProject(project) + "/jobs/" + jobId + "/artifacts/" + rest;
+      }
+    }
+  }
+  return url;
+}
+
+// -------------------- Partial-State Journal --------------------
+//
+// Text sidecar next to "<file>.part" describing which bytes of the part
+// file are already valid:
+//
+//   NRLJ 1
+//   size <content length>
+//   etag <strong ETag>
+//   last-modified <Last-Modified>
+//   segment <start> <length> <written>
+//   ...
+//
+// It is rewritten (temp file + rename) every kJournalInterval bytes and when
+// a transfer stops, always after the segment data has been flushed.
+
+static const curl_off_t kJournalInterval = 4 * 1024 * 1024;
+
+namespace {
+
+struct Journal {
+  curl_off_t size = -1;
+  std::string etag;
+  std::string lastModified;
+  struct Range {
+    curl_off_t start, length, written;
+  };
+  std::vector<Range> segments;
+};
+
+} // namespace
+
+static bool readJournal(const std::string& path, Journal& j) {
+  FILE* fp = fopen(path.c_str(), "r");
+  if (!fp)
+    return false;
+
+  char line[1024];
+  bool ok = fgets(line, sizeof(line), fp) && strcmp(line, "NRLJ 1\n") == 0;
+  while (ok && fgets(line, sizeof(line), fp)) {
+    std::string l(line);
+    if (!l.empty() && l.back() == '\n')
+      l.pop_back();
+    long long start, length, written;
+    if (l.rfind("size ", 0) == 0) {
+      j.size = strtoll(l.c_str() + 5, nullptr, 10);
+    } else if (l.rfind("etag ", 0) == 0) {
+      j.etag = l.substr(5);
+    } else if (l.rfind("last-modified ", 0) == 0) {
+      j.lastModified = l.substr(14);
+    } else if (sscanf(l.c_str(), "segment %lld %lld %lld", &start, &length,
+                      &written) == 3) {
+      if (start < 0 || length <= 0 || written < 0 || written > length)
+        ok = false;
+      j.segments.push_back({start, length, written});
+    }
+  }
+  fclose(fp);
+  return ok && j.size > 0 && !j.segments.empty();
+}
+
+// The segments must tile the file exactly: a gap would leave bytes that
+// are never fetched but still hashed, an overlap or overrun writes where
+// another segment (or nothing) belongs.
+static bool coversFile(const Journal& j) {
+  std::vector<Journal::Range> ranges = j.segments;
+  std::sort(ranges.begin(), ranges.end(),
+            [](const Journal::Range& a, const Journal::Range& b) {
+              return a.start < b.start;
+            });
+  curl_off_t end = 0;
+  for (auto& r : ranges) {
+    if (r.start != end || r.length > j.size - r.start)
+      return false;
+    end = r.start + r.length;
+  }
+  return end == j.size;
+}
+
+static bool writeJournal(const std::string& path, const Journal& j) {
+  std::string tmp = path + ".tmp";
+  FILE* fp = fopen(tmp.c_str(), "w");
+  if (!fp)
+    return false;
+  fprintf(fp, "NRLJ 1\nsize %lld\n", (long long)j.size);
+  if (!j.etag.empty())
+    fprintf(fp, "etag %s\n", j.etag.c_str());
+  if (!j.lastModified.empty())
+    fprintf(fp, "last-modified %s\n", j.lastModified.c_str());
+  for (auto& r : j.segments) {
+    fprintf(fp, "segment %lld %lld %lld\n", (long long)r.start,
+            (long long)r.length, (long long)r.written);
+  }
+  if (fclose(fp) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  remove(path.c_str());
+  return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Weak validators do not promise byte-identical content, so they cannot
+// vouch for a partial file.
+static bool isStrongEtag(const std::string& etag) {
+  return !etag.empty() && etag.rfind("W/", 0) != 0;
+}
+
+// -------------------- Segmented Download Engine --------------------
+
+DownloadJob::DownloadJob(const std::string& url, const std::string& token,
+                         const std::string& outPath, DownloadCallbackData cb)
+    : url(url), token(token), outPath(outPath), cb(cb), partPath(outPath + ".part"), journalPath(outPath + ".part.journal") {
+  if (!token.empty()) {
+    headers = curl_slist_append(headers, ("PRIVATE-TOKEN: " + token).c_str());
+  }
+  sha256ContextCreate(&hasher);
+}
+
+DownloadJob::~DownloadJob() {
+  if (poolListener)
+    DiskPipeline::get().pool().removeListener(poolListener);
+  segments.clear();
+  probe.reset();
+  if (headers)
+    curl_slist_free_all(headers);
+  if (rangeHeaders)
+    curl_slist_free_all(rangeHeaders);
+}
+
+size_t DownloadJob::SegmentWrite(char* ptr, size_t size, size_t nmemb,
+                                 void* userdata) {
+  auto* seg = static_cast<Segment*>(userdata);
+  size_t n = size * nmemb;
+
+  // A server that ignores Range (or whose If-Range no longer matches)
+  // answers 200 with the whole body; writing that at our offset would
+  // corrupt the file.
+  if (!seg->rangeChecked) {
+    seg->rangeChecked = true;
+    long code = seg->curl.getResponseCode();
+    if (seg->length >= 0 && code != 206)
+      return 0;
+    seg->redirected = code >= 300 && code < 400;
+  }
+  // The page of a redirect, followed in handleDone(); not the file.
+  if (seg->redirected)
+    return n;
+  if (seg->length >= 0 && seg->written + (curl_off_t)n > seg->length)
+    return 0;
+
+  WriteResult wr =
+      seg->unzip ? seg->unzip->write(ptr, n) : seg->writer->write(ptr, n);
+  switch (wr) {
+  case WriteResult::Ok:
+    break;
+  case WriteResult::Full:
+    // Every pool buffer is waiting for the disk: stop reading from this
+    // socket until one is returned instead of buffering more.
+    seg->paused = true;
+    if (!seg->starved) {
+      seg->starved = true;
+      ++seg->job->bufferWaits;
+    }
+    return CURL_WRITEFUNC_PAUSE;
+  case WriteResult::Error:
+    return 0;
+  }
+  seg->starved = false;
+  if (seg->job->phases.firstByteMs < 0)
+    seg->job->phases.firstByteMs = std::chrono::duration_cast<
+        std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                   seg->job->started).count();
+  if (!seg->unzip)
+    seg->job->hashInOrder(seg->start + seg->written, ptr, n);
+  seg->written += n;
+  seg->job->updateProgress();
+  return n;
+}
+
+int DownloadJob::SegmentProgress(void* clientp, curl_off_t dltotal,
+                                 curl_off_t, curl_off_t, curl_off_t) {
+  auto* seg = static_cast<Segment*>(clientp);
+  if (seg->length < 0)
+    seg->job->cb.dl_total_ptr->store(dltotal);
+  return seg->job->cb.canceled_ptr->load() ? 1 : 0;
+}
+
+void DownloadJob::updateProgress() {
+  curl_off_t sum = 0;
+  for (auto& seg : segments)
+    sum += seg->written;
+  cb.dl_now_ptr->store(sum);
+
+  if (resumable && sum - lastJournaled >= kJournalInterval) {
+    saveJournal();
+    lastJournaled = sum;
+  }
+}
+
+void DownloadJob::hashInOrder(curl_off_t offset, const char* data, size_t n) {
+  if (offset != hashed)
+    return;
+  sha256ContextUpdate(&hasher, data, n);
+  hashed += n;
+}
+
+bool DownloadJob::finishHash() {
+  // Everything is on disk by now; pick up what did not arrive in order.
+  struct stat st;
+  if (stat(partPath.c_str(), &st) != 0)
+    return false;
+  if (hashed < st.st_size && !hashFileFrom(partPath, hashed, hasher)) {
+    std::cerr << "Failed to hash " << partPath << "\n";
+    return false;
+  }
+  digest = digestHex(hasher);
+  return true;
+}
+
+void DownloadJob::saveJournal() {
+  Journal j;
+  j.size = contentLength;
+  j.etag = etag;
+  j.lastModified = lastModified;
+  for (auto& seg : segments) {
+    // Only bytes that reached the file may be recorded, not those still
+    // sitting in a staging buffer.
+    curl_off_t durable = seg->resumedAt;
+    if (seg->writer)
+      durable += seg->writer->flushedBytes();
+    j.segments.push_back({seg->start, seg->length, durable});
+  }
+  if (!writeJournal(journalPath, j))
+    std::cerr << "Failed to write " << journalPath << "\n";
+}
+
+void DownloadJob::extractTo(std::vector<std::string> suffixes) {
+  extracting = true;
+  extractSuffixes = std::move(suffixes);
+}
+
+void DownloadJob::start(CURLM* multi) {
+  started = std::chrono::steady_clock::now();
+  // Wake the multi loop whenever the disk thread frees a buffer so paused
+  // segments get a chance to continue. The pool drops the listener under
+  // its lock, in finish() or the destructor, before `this` goes away.
+  poolListener = DiskPipeline::get().pool().addListener([this, multi]() {
+    bufferReturned = true;
+    curl_multi_wakeup(multi);
+  });
+
+  probe = std::make_unique<CurlEasy>();
+  CurlEasy& curl = *probe;
+  pointAt(curl, url);
+  curl.setopt(CURLOPT_NOBODY, 1L);
+  curl.preferHttp2();
+  curl_easy_setopt(curl.getHandle(), CURLOPT_HEADERFUNCTION,
+                   HeaderBuffer::HeaderCallback);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_HEADERDATA, &probeHeaders);
+  curl_multi_add_handle(multi, curl.getHandle());
+}
+
+bool DownloadJob::handleDone(CURLM* multi, CURL* easy, CURLcode res) {
+  if (probe && easy == probe->getHandle()) {
+    curl_multi_remove_handle(multi, easy);
+    std::string next = res == CURLE_OK ? redirectTarget(easy) : std::string();
+    if (!next.empty() && redirects++ < kMaxRedirects) {
+      pointAt(*probe, next);
+      curl_multi_add_handle(multi, easy);
+      return true;
+    }
+    if (res == CURLE_OK && probe->getResponseCode() == 200) {
+      char* effective = nullptr;
+      curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &effective);
+      if (effective)
+        finalUrl = effective;
+      curl_easy_getinfo(easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                        &contentLength);
+      acceptRanges = probeHeaders.get("Accept-Ranges") == "bytes";
+      etag = probeHeaders.get("ETag");
+      lastModified = probeHeaders.get("Last-Modified");
+    }
+    // The HEAD answer's first byte is not the body's; that comes later.
+    readPhaseTimes(easy, phases);
+    phases.firstByteMs = -1;
+    probe.reset();
+
+    if (cb.canceled_ptr->load())
+      finish(multi, false);
+    else
+      startTransfer(multi);
+    return true;
+  }
+
+  for (auto& seg : segments) {
+    if (seg->curl.getHandle() != easy)
+      continue;
+    curl_multi_remove_handle(multi, easy);
+    long code = seg->curl.getResponseCode();
+    if (res == CURLE_OK && seg->length < 0 && code >= 300 && code < 400) {
+      // Nothing of the redirect was written; ask the new location.
+      std::string next = redirectTarget(easy);
+      if (!next.empty() && redirects++ < kMaxRedirects) {
+        finalUrl = next;
+        seg->rangeChecked = false;
+        seg->redirected = false;
+        startSegment(multi, *seg);
+        return true;
+      }
+      res = next.empty() ? CURLE_HTTP_RETURNED_ERROR : CURLE_TOO_MANY_REDIRECTS;
+    }
+    bool flushed = seg->unzip ? seg->unzip->finish() : seg->writer->close();
+    bool complete = seg->length < 0 || seg->written == seg->length;
+
+    if (res != CURLE_OK || !flushed || cb.canceled_ptr->load() || !complete) {
+      // A body that ended early is as good as a dropped connection.
+      if (flushed && !cb.canceled_ptr->load() &&
+          scheduleRetry(*seg, res == CURLE_OK ? CURLE_PARTIAL_FILE : res))
+        return true;
+      seg->done = true;
+      if (res != CURLE_OK && !cb.canceled_ptr->load())
+        std::cerr << "CURL error: " << curl_easy_strerror(res) << "\n";
+      if (!flushed)
+        std::cerr << "Write error on " << partPath << "\n";
+      finish(multi, false);
+      return true;
+    }
+    seg->done = true;
+
+    bool all = true;
+    for (auto& other : segments)
+      all = all && other->done;
+    if (all)
+      finish(multi, true);
+    return true;
+  }
+  return false;
+}
+
+bool DownloadJob::resumeFromJournal(CURLM* multi) {
+  Journal j;
+  if (!readJournal(journalPath, j))
+    return false;
+
+  bool sameEtag = isStrongEtag(etag) && j.etag == etag;
+  bool sameDate = etag.empty() && !lastModified.empty() &&
+                  j.lastModified == lastModified;
+  struct stat st;
+  if (!(sameEtag || sameDate) || j.size != contentLength || !coversFile(j) ||
+      stat(partPath.c_str(), &st) != 0 || st.st_size != contentLength) {
+    std::cerr << "Discarding stale or damaged partial download " << partPath
+              << "\n";
+    return false;
+  }
+
+  cb.dl_total_ptr->store(contentLength);
+  for (auto& r : j.segments) {
+    addSegment(multi, r.start, r.length, r.written);
+    if (state == State::Done)
+      return true;
+  }
+  updateProgress();
+  lastJournaled = cb.dl_now_ptr->load();
+
+  bool all = true;
+  for (auto& seg : segments)
+    all = all && seg->done;
+  if (all)
+    finish(multi, true);
+  return true;
+}
+
+void DownloadJob::startTransfer(CURLM* multi) {
+  state = State::Transferring;
+
+  if (extracting) {
+    // The archive is unpacked in order from a single stream; there is no
+    // part file to resume into.
+    if (contentLength > 0)
+      cb.dl_total_ptr->store(contentLength);
+    addSegment(multi, 0, -1, 0);
+    return;
+  }
+
+  resumable = !finalUrl.empty() && acceptRanges && contentLength > 0 &&
+              (isStrongEtag(etag) || (etag.empty() && !lastModified.empty()));
+  bool ranged = !finalUrl.empty() && acceptRanges && contentLength > 0;
+
+  if (ranged) {
+    // Ranged requests go straight to the resolved location. The token is
+    // only sent back to the host that issued it, not to object storage.
+    if (headers && urlHost(finalUrl) == urlHost(url))
+      rangeHeaders = curl_slist_append(rangeHeaders,
+                                       ("PRIVATE-TOKEN: " + token).c_str());
+    // If the file changes between the probe and a segment request, the
+    // server answers 200 and the segment aborts instead of mixing content.
+    std::string validator = isStrongEtag(etag) ? etag : lastModified;
+    if (!validator.empty())
+      rangeHeaders = curl_slist_append(rangeHeaders,
+                                       ("If-Range: " + validator).c_str());
+  }
+
+  if (resumable && resumeFromJournal(multi))
+    return;
+  remove(journalPath.c_str());
+
+  FILE* fp = fopen(partPath.c_str(), "wb");
+  if (!fp) {
+    std::cerr << "Failed to open " << partPath << "\n";
+    finish(multi, false);
+    return;
+  }
+  // Reserve the whole file up front so segments can write at their offsets.
+  if (ranged && ftruncate(fileno(fp), contentLength) != 0) {
+    ranged = false;
+    resumable = false;
+  }
+  fclose(fp);
+
+  if (!ranged) {
+    addSegment(multi, 0, -1, 0);
+    return;
+  }
+
+  cb.dl_total_ptr->store(contentLength);
+  curl_off_t count = contentLength / kMinSegmentSize;
+  if (contentLength < kMinSegmentedSize || count < 1)
+    count = 1;
+  if (count > kMaxSegments)
+    count = kMaxSegments;
+  curl_off_t step = (contentLength + count - 1) / count;
+  step = (step + kSegmentAlign - 1) / kSegmentAlign * kSegmentAlign;
+  for (curl_off_t start = 0; start < contentLength && state != State::Done;
+       start += step) {
+    curl_off_t length = contentLength - start < step ? contentLength - start : step;
+    addSegment(multi, start, length, 0);
+  }
+  if (resumable && state != State::Done)
+    saveJournal();
+}
+
+void DownloadJob::addSegment(CURLM* multi, curl_off_t start,
+                             curl_off_t length, curl_off_t written) {
+  auto seg = std::make_unique<Segment>();
+  seg->job = this;
+  seg->start = start;
+  seg->length = length;
+  seg->written = written;
+  seg->resumedAt = written;
+  if (length >= 0 && written >= length) {
+    seg->done = true;
+    segments.push_back(std::move(seg));
+    return;
+  }
+
+  if (extracting) {
+    seg->unzip = std::make_unique<ZipExtractor>(outPath + "-", extractSuffixes);
+  } else {
+    seg->writer = std::make_unique<AlignedWriter>(DiskPipeline::get());
+  }
+  if (seg->writer && !seg->writer->open(partPath, start + written)) {
+    std::cerr << "Failed to open " << partPath << "\n";
+    seg->writer.reset();
+    seg->done = true;
+    segments.push_back(std::move(seg));
+    finish(multi, false);
+    return;
+  }
+
+  segments.push_back(std::move(seg));
+  startSegment(multi, *segments.back());
+}
+
+void DownloadJob::startSegment(CURLM* multi, Segment& seg) {
+  CurlEasy& curl = seg.curl;
+  if (seg.length >= 0) {
+    curl.setopt(CURLOPT_URL, finalUrl.c_str());
+    if (rangeHeaders)
+      curl.setopt(CURLOPT_HTTPHEADER, rangeHeaders);
+    char range[64];
+    snprintf(range, sizeof(range), "%lld-%lld",
+             (long long)(seg.start + seg.written),
+             (long long)(seg.start + seg.length - 1));
+    curl.setopt(CURLOPT_RANGE, range);
+    // Segments exist to get several TCP windows; multiplexed onto the
+    // probe's h2 connection they would all share one.
+    curl.requireHttp1();
+  } else {
+    // Where the probe ended up, when it got that far.
+    pointAt(curl, finalUrl.empty() ? url : finalUrl);
+  }
+  curl.setopt(CURLOPT_FAILONERROR, 1L);
+  curl.setopt(CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_MAX_RECV_SPEED_LARGE, maxRecvSpeed);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_XFERINFOFUNCTION, SegmentProgress);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_XFERINFODATA, &seg);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEFUNCTION, SegmentWrite);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEDATA, &seg);
+
+  curl_multi_add_handle(multi, curl.getHandle());
+}
+
+void DownloadJob::pointAt(CurlEasy& curl, const std::string& at) {
+  curl.setopt(CURLOPT_URL, at.c_str());
+  curl.setopt(CURLOPT_HTTPHEADER,
+              urlHost(at) == urlHost(url) ? headers : nullptr);
+}
+
+bool DownloadJob::scheduleRetry(Segment& seg, CURLcode res) {
+  // An archive is unpacked from one stream, and a plain GET cannot pick up
+  // in the middle; both start over only if nothing has arrived yet.
+  if (seg.unzip || (seg.length < 0 && seg.written > 0))
+    return false;
+  if (seg.attempts >= kTransferPolicy.maxAttempts ||
+      !isRetryableFailure(res, seg.curl.getResponseCode()))
+    return false;
+
+  std::chrono::milliseconds delay = retryDelay(seg.attempts, kTransferPolicy);
+  ++seg.attempts;
+  seg.waiting = true;
+  seg.retryAt = std::chrono::steady_clock::now() + delay;
+  // The writer was closed above, so everything written so far is durable.
+  seg.resumedAt = seg.written;
+  seg.writer.reset();
+  if (resumable)
+    saveJournal();
+  std::cerr << "Retrying " << partPath << " from byte "
+            << seg.start + seg.written << " in " << delay.count() << " ms ("
+            << curl_easy_strerror(res) << ")\n";
+  return true;
+}
+
+void DownloadJob::finish(CURLM* multi, bool success) {
+  if (state == State::Done)
+    return;
+  for (auto& seg : segments) {
+    if (seg->done)
+      continue;
+    seg->done = true;
+    if (seg->waiting)
+      continue;
+    curl_multi_remove_handle(multi, seg->curl.getHandle());
+    if (seg->writer)
+      seg->writer->close();
+  }
+
+  DiskPipeline::get().pool().removeListener(poolListener);
+  poolListener = 0;
+
+  state = State::Done;
+  ok = success;
+  if (extracting) {
+    for (auto& seg : segments) {
+      if (!seg->unzip)
+        continue;
+      if (ok)
+        extracted = seg->unzip->files();
+      else
+        seg->unzip->discard();
+    }
+    return;
+  }
+  if (success && !finishHash())
+    ok = false;
+  if (ok) {
+    remove(journalPath.c_str());
+    remove(outPath.c_str());
+    if (rename(partPath.c_str(), outPath.c_str()) != 0) {
+      std::cerr << "Failed to rename " << partPath << "\n";
+      ok = false;
+    }
+  } else if (resumable && !segments.empty()) {
+    // Keep what we have; the next attempt continues from the journal.
+    saveJournal();
+  } else {
+    remove(partPath.c_str());
+    remove(journalPath.c_str());
+  }
+}
+
+void DownloadJob::setMaxRecvSpeed(curl_off_t bytesPerSecond) {
+  maxRecvSpeed = bytesPerSecond;
+  for (auto& seg : segments) {
+    if (!seg->done)
+      curl_easy_setopt(seg->curl.getHandle(), CURLOPT_MAX_RECV_SPEED_LARGE,
+                       maxRecvSpeed);
+  }
+}
+
+int DownloadJob::connectionCount() const {
+  if (probe)
+    return 1;
+  int n = 0;
+  for (auto& seg : segments)
+    n += seg->done || seg->waiting ? 0 : 1;
+  return n;
+}
+
+bool DownloadJob::waitingOnDisk() const {
+  for (auto& seg : segments) {
+    if (seg->paused && !seg->done)
+      return true;
+  }
+  return false;
+}
+
+void DownloadJob::resumePaused(CURLM* multi) {
+  if (state != State::Transferring)
+    return;
+  auto now = std::chrono::steady_clock::now();
+  bool running = false;
+  for (auto& seg : segments) {
+    if (seg->done)
+      continue;
+    if (!seg->waiting) {
+      running = true;
+      continue;
+    }
+    if (now < seg->retryAt || cb.canceled_ptr->load())
+      continue;
+    seg->writer = std::make_unique<AlignedWriter>(DiskPipeline::get());
+    if (!seg->writer->open(partPath, seg->start + seg->written)) {
+      std::cerr << "Failed to open " << partPath << "\n";
+      seg->writer.reset();
+      finish(multi, false);
+      return;
+    }
+    seg->waiting = false;
+    seg->rangeChecked = false;
+    seg->paused = false;
+    seg->starved = false;
+    startSegment(multi, *seg);
+    running = true;
+  }
+  // Running segments see a cancel in their progress callback; waiting
+  // ones would not until their backoff ran out.
+  if (!running && cb.canceled_ptr->load()) {
+    finish(multi, false);
+    return;
+  }
+
+  // Until a buffer comes back, a paused segment would only be handed the
+  // same data again and pause right away.
+  if (!bufferReturned.exchange(false))
+    return;
+  for (auto& seg : segments) {
+    if (!seg->paused || seg->done || seg->waiting)
+      continue;
+    // May call SegmentWrite right away, which can pause it again.
+    seg->paused = false;
+    curl_easy_pause(seg->curl.getHandle(), CURLPAUSE_CONT);
+  }
+}
+
+bool runDownloadJob(DownloadJob& job) {
+  CurlMulti multi;
+  job.start(multi.getHandle());
+  while (!job.isFinished()) {
+    multi.perform(100);
+    while (CURLMsg* msg = multi.nextDone())
+      job.handleDone(multi.getHandle(), msg->easy_handle, msg->data.result);
+    job.resumePaused(multi.getHandle());
+    // Only segments waiting out a backoff left: nothing for perform() to
+    // wait on.
+    if (!job.isFinished() && job.connectionCount() == 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return job.succeeded();
+}
@@ -0,0 +1,214 @@
+#ifndef DOWNLOAD_H
+#define DOWNLOAD_H
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+#include "model.h"
+#include "net.h"
+#include "sha256.h"
+#include "unzip.h"
+#include "writer.h"
+
+// -------------------- Download Helpers --------------------
+
+// `s` with characters FAT cannot store in a file name replaced by '_'.
+std::string fatSafeName(std::string_view s);
+
+// Output file name for an asset: the last URL path component without query,
+// passed through fatSafeName().
+std::string downloadFileName(const Asset& a);
+
+// True for GitLab job-artifact archive links, which are unpacked while they
+// download (see DownloadJob::extractTo()). Plain .zip assets are not.
+bool isArtifactArchive(const Asset& a);
+
+// Rewrites GitLab web job-artifact links (/-/jobs/<id>/artifacts/...) to the
+// API endpoint, which accepts PRIVATE-TOKEN authentication.
+std::string resolveArtifactUrl(const std::string& url);
+
+struct DownloadCallbackData {
+  std::atomic<bool>* canceled_ptr;
+  std::atomic<curl_off_t>* dl_total_ptr;
+  std::atomic<curl_off_t>* dl_now_ptr;
+};
+
+// -------------------- Segmented Download Engine --------------------
+
+// Downloads one URL into one file as a non-blocking state machine that is
+// driven by a caller-owned curl_multi handle.
+//
+// The job first HEADs the URL and follows its redirects. When the final
+// location reports a length and Accept-Ranges: bytes, the file is
+// preallocated and split into byte ranges fetched over parallel connections,
+// each one writing at its own offset. Otherwise it falls back to a single
+// GET. Progress from all segments is summed into the DownloadCallbackData
+// counters.
+//
+// Data lands in "<outPath>.part", renamed into place on success. When the
+// server offers a strong validator (ETag, else Last-Modified) a journal
+// beside the part file records the completed bytes of each segment; a failed
+// or cancelled job keeps both, and the next job for the same path resumes
+// with Range requests if the validator is unchanged.
+//
+// Segments never touch the file from the network callback: bytes are copied
+// into pool buffers and written out by the DiskPipeline thread. When the
+// pool runs dry a segment pauses itself (CURL_WRITEFUNC_PAUSE) and is
+// resumed by resumePaused() after the pool wakes the multi handle.
+//
+// A segment that fails in a way another attempt might get past (see
+// isRetryableFailure()) is retried on its own after a backoff, from the
+// first byte it is missing; the rest of the job carries on meanwhile. Only
+// when one runs out of attempts does the job fail.
+//
+// The file's SHA-256 is computed from the bytes as they stream in, as long
+// as they arrive in file order: a single GET and the first segment are
+// hashed in flight. Whatever lies beyond that (later segments, or bytes
+// resumed from an earlier run) is read back once at the end.
+class DownloadJob {
+public:
+  DownloadJob(const std::string& url, const std::string& token,
+              const std::string& outPath, DownloadCallbackData cb);
+  ~DownloadJob();
+
+  DownloadJob(const DownloadJob&) = delete;
+  DownloadJob& operator=(const DownloadJob&) = delete;
+
+  void start(CURLM* multi);
+
+  // Returns true when `easy` belongs to this job and advances the job.
+  bool handleDone(CURLM* multi, CURL* easy, CURLcode res);
+
+  // Unpauses segments stopped for lack of buffers and restarts failed ones
+  // whose backoff has passed; call after every curl_multi round.
+  void resumePaused(CURLM* multi);
+
+  // Treats the download as a zip archive and unpacks the entries ending in
+  // one of `suffixes` while it streams in (see ZipExtractor), instead of
+  // saving the archive. Such a job uses a single connection and cannot
+  // resume. Must be called before start().
+  void extractTo(std::vector<std::string> suffixes);
+  // Files unpacked by a successful extracting job, next to outPath.
+  const std::vector<ZipExtractor::File>& extractedFiles() const {
+    return extracted;
+  }
+
+  // Caps the receive rate of each of this job's connections (0: no cap).
+  // Applies to running segments as well as ones added later.
+  void setMaxRecvSpeed(curl_off_t bytesPerSecond);
+  // Connections currently transferring (the probe counts as one).
+  int connectionCount() const;
+
+  // DNS, connect and TLS times of the probe's connection; first byte is
+  // the first body byte, counted from start().
+  const PhaseTimes& phaseTimes() const { return phases; }
+  // A segment is paused for lack of write buffers.
+  bool waitingOnDisk() const;
+  // How often that has happened.
+  int diskWaits() const { return bufferWaits; }
+
+  bool isFinished() const { return state == State::Done; }
+  bool succeeded() const { return ok; }
+  // True when a failed or cancelled job left a partial file to resume from.
+  bool canResume() const { return state == State::Done && !ok && resumable; }
+  // Lowercase hex SHA-256 of the finished file; empty unless succeeded().
+  const std::string& sha256() const { return digest; }
+
+private:
+  struct Segment {
+    DownloadJob* job = nullptr;
+    CurlEasy curl;
+    std::unique_ptr<AlignedWriter> writer;
+    std::unique_ptr<ZipExtractor> unzip; // instead of writer when extracting
+    curl_off_t start = 0;
+    curl_off_t length = -1; // -1: unknown, read until the server stops
+    curl_off_t written = 0;
+    curl_off_t resumedAt = 0; // bytes already in the file when added
+    bool rangeChecked = false;
+    // The single GET answered with a redirect; its body is dropped.
+    bool redirected = false;
+    bool paused = false;
+    // Out of buffers since the last write that went through; counted once
+    // in bufferWaits however often it is unpaused in between.
+    bool starved = false;
+    bool done = false;
+    // Failed and not in the multi until retryAt.
+    bool waiting = false;
+    int attempts = 1;
+    std::chrono::steady_clock::time_point retryAt;
+  };
+
+  enum class State { Probing, Transferring, Done };
+
+  static size_t SegmentWrite(char* ptr, size_t size, size_t nmemb, void* userdata);
+  static int SegmentProgress(void* clientp, curl_off_t dltotal,
+                             curl_off_t dlnow, curl_off_t, curl_off_t);
+
+  void startTransfer(CURLM* multi);
+  bool resumeFromJournal(CURLM* multi);
+  void addSegment(CURLM* multi, curl_off_t start, curl_off_t length,
+                  curl_off_t written);
+  void startSegment(CURLM* multi, Segment& seg);
+  // Aims `curl` at `at`, with the token only while on the host of `url`.
+  void pointAt(CurlEasy& curl, const std::string& at);
+  bool scheduleRetry(Segment& seg, CURLcode res);
+  void finish(CURLM* multi, bool success);
+  void updateProgress();
+  void saveJournal();
+  void hashInOrder(curl_off_t offset, const char* data, size_t n);
+  bool finishHash();
+
+  std::string url;
+  std::string token;
+  std::string outPath;
+  DownloadCallbackData cb;
+  std::string partPath;
+  std::string journalPath;
+
+  State state = State::Probing;
+  bool ok = false;
+
+  std::unique_ptr<CurlEasy> probe;
+  HeaderBuffer probeHeaders;
+  std::string finalUrl;
+  curl_off_t contentLength = -1;
+  bool acceptRanges = false;
+  std::string etag;
+  std::string lastModified;
+  bool resumable = false;
+  curl_off_t lastJournaled = 0;
+
+  struct curl_slist* headers = nullptr;
+  struct curl_slist* rangeHeaders = nullptr;
+  int poolListener = 0;
+  // Redirects followed so far, by the probe and the single GET.
+  int redirects = 0;
+  // Set by the pool listener on the disk thread; paused segments are only
+  // worth continuing once a buffer has come back.
+  std::atomic<bool> bufferReturned{false};
+  curl_off_t maxRecvSpeed = 0;
+  std::vector<std::unique_ptr<Segment>> segments;
+
+  bool extracting = false;
+  std::vector<std::string> extractSuffixes;
+  std::vector<ZipExtractor::File> extracted;
+
+  std::chrono::steady_clock::time_point started;
+  PhaseTimes phases;
+  int bufferWaits = 0;
+
+  Sha256Context hasher;
+  curl_off_t hashed = 0; // bytes from the start of the file fed to hasher
+  std::string digest;
+};
+
+// Runs a single job on its own multi handle until it finishes.
+bool runDownloadJob(DownloadJob& job);
+
+#endif // DOWNLOAD_H
@@ -0,0 +1,67 @@
+#include <iostream>
+
+#include "frames.h"
+
+// Frames without input before falling back to the idle poll (~2 s).
+static const u64 kIdleAfterFrames = 120;
+// Frames without input before the poll slows down further (~30 s).
+static const u64 kDormantAfterFrames = 1800;
+// Poll intervals while idle (10 Hz) and dormant (2 Hz). The pad cannot
+// wake us, so each is also the latency of the first press after it.
+static const u64 kIdlePollNs = 100'000'000ULL;
+static const u64 kDormantPollNs = 500'000'000ULL;
+// Sleep per frame when there is no vsync event to wait on.
+static const u64 kFallbackFrameNs = 16'666'667ULL;
+// Bound on a single vsync wait, should the display stop signalling.
+static const u64 kVsyncTimeoutNs = 100'000'000ULL;
+
+// -------------------- Frame Scheduler --------------------
+
+FrameScheduler& FrameScheduler::get() {
+  static FrameScheduler scheduler;
+  return scheduler;
+}
+
+FrameScheduler::FrameScheduler() {
+  ueventCreate(&wake, true);
+  if (R_FAILED(viInitialize(ViServiceType_Default))) {
+    std::cerr << "vi init failed; pacing frames with a timer\n";
+    return;
+  }
+  if (R_FAILED(viOpenDefaultDisplay(&display))) {
+    viExit();
+    return;
+  }
+  if (R_FAILED(viGetDisplayVsyncEvent(&display, &vsync))) {
+    viCloseDisplay(&display);
+    viExit();
+    return;
+  }
+  haveVsync = true;
+}
+
+void FrameScheduler::notify() { ueventSignal(&wake); }
+
+FrameScheduler::~FrameScheduler() {
+  if (!haveVsync)
+    return;
+  eventClose(&vsync);
+  viCloseDisplay(&display);
+  viExit();
+}
+
+void FrameScheduler::wait() {
+  ++frames;
+  u64 quiet = frames - lastActive;
+  if (quiet > kIdleAfterFrames) {
+    // Applet messages and background work wake the loop straight away;
+    // waitMulti() leaves the message to appletMainLoop().
+    s32 index;
+    u64 timeout = quiet > kDormantAfterFrames ? kDormantPollNs : kIdlePollNs;
+    waitMulti(&index, timeout, waiterForEvent(appletGetMessageEvent()),
+              waiterForUEvent(&wake));
+  } else if (haveVsync)
+    eventWait(&vsync, kVsyncTimeoutNs);
+  else
+    svcSleepThread(kFallbackFrameNs);
+}
@@ -0,0 +1,42 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <switch.h>
+
+// -------------------- Frame Scheduler --------------------
+
+// Paces the UI loops. While the user is interacting, wait() returns on each
+// display vsync (60 Hz), so input is handled within a frame of arriving.
+// After about 2 s without input it polls the pad at 10 Hz, and after 30 s
+// at 2 Hz, so an idle browser barely wakes the CPU. An applet message or
+// notify() ends an idle wait early. Falls back to a fixed sleep when the vsync
+// event cannot be opened.
+class FrameScheduler {
+public:
+  static FrameScheduler& get();
+  ~FrameScheduler();
+
+  FrameScheduler(const FrameScheduler&) = delete;
+  FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+  void wait();
+
+  // Call when input arrives; keeps the loop on vsync pacing.
+  void markActive() { lastActive = frames; }
+
+  // Ends the current idle wait so the loop can redraw; for background
+  // work that changed what is shown. Any thread.
+  void notify();
+
+private:
+  FrameScheduler();
+
+  bool haveVsync = false;
+  ViDisplay display;
+  Event vsync;
+  UEvent wake;
+  u64 frames = 0;
+  u64 lastActive = 0;
+};
+
+#endif // FRAMES_H
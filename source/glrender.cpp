@@ -0,0 +1,305 @@
+#ifdef NRL_GL_UI
+
+#include <cstddef>
+#include <iostream>
+
+#include "glrender.h"
+
+// The default window is 1280x720 in handheld and docked mode alike.
+static const int kFramebufferWidth = 1280;
+static const int kFramebufferHeight = 720;
+
+static const float kBackground[4] = {0.08f, 0.09f, 0.11f, 1.0f};
+static const float kText[4] = {0.88f, 0.89f, 0.91f, 1.0f};
+static const float kHeader[4] = {0.55f, 0.78f, 1.0f, 1.0f};
+static const float kSelection[4] = {0.20f, 0.32f, 0.52f, 1.0f};
+static const float kGaugeTrack[4] = {0.22f, 0.23f, 0.26f, 1.0f};
+static const float kGaugeFill[4] = {0.36f, 0.74f, 0.42f, 1.0f};
+
+static const char* kVertexShader =
+    "attribute vec2 aPos;\n"
+    "attribute vec2 aUv;\n"
+    "attribute vec4 aColor;\n"
+    "uniform vec2 uView;\n"
+    "varying vec2 vUv;\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "  gl_Position = vec4(aPos.x / uView.x * 2.0 - 1.0,\n"
+    "                     1.0 - aPos.y / uView.y * 2.0, 0.0, 1.0);\n"
+    "  vUv = aUv;\n"
+    "  vColor = aColor;\n"
+    "}\n";
+
+static const char* kFragmentShader =
+    "precision mediump float;\n"
+    "uniform sampler2D uAtlas;\n"
+    "varying vec2 vUv;\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "  gl_FragColor = vec4(vColor.rgb, vColor.a * texture2D(uAtlas, vUv).a);\n"
+    "}\n";
+
+static GLuint compileShader(GLenum type, const char* source) {
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    char log[512];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    std::cerr << "Shader compile failed: " << log << "\n";
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+// -------------------- GPU Text Renderer --------------------
+
+GlRenderer::~GlRenderer() {
+  if (display == EGL_NO_DISPLAY)
+    return;
+  if (vbo)
+    glDeleteBuffers(1, &vbo);
+  if (atlas)
+    glDeleteTextures(1, &atlas);
+  if (program)
+    glDeleteProgram(program);
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (context != EGL_NO_CONTEXT)
+    eglDestroyContext(display, context);
+  if (surface != EGL_NO_SURFACE)
+    eglDestroySurface(display, surface);
+  eglTerminate(display);
+}
+
+bool GlRenderer::initEgl(NWindow* window) {
+  display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+    std::cerr << "EGL init failed: " << eglGetError() << "\n";
+    display = EGL_NO_DISPLAY;
+    return false;
+  }
+  eglBindAPI(EGL_OPENGL_ES_API);
+
+  static const EGLint configAttributes[] = {
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+      EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+      EGL_NONE};
+  EGLConfig config;
+  EGLint configCount = 0;
+  if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) ||
+      configCount == 0) {
+    std::cerr << "No EGL config: " << eglGetError() << "\n";
+    return false;
+  }
+
+  surface = eglCreateWindowSurface(display, config, window, nullptr);
+  if (surface == EGL_NO_SURFACE) {
+    std::cerr << "EGL surface failed: " << eglGetError() << "\n";
+    return false;
+  }
+
+  static const EGLint contextAttributes[] = {EGL_CONTEXT_CLIENT_VERSION, 2,
+                                             EGL_NONE};
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+  if (context == EGL_NO_CONTEXT) {
+    std::cerr << "EGL context failed: " << eglGetError() << "\n";
+    return false;
+  }
+  eglMakeCurrent(display, surface, surface, context);
+  // FrameScheduler already paces frames on vsync; swaps only queue.
+  eglSwapInterval(display, 1);
+  return true;
+}
+
+bool GlRenderer::initProgram() {
+  GLuint vs = compileShader(GL_VERTEX_SHADER, kVertexShader);
+  GLuint fs = compileShader(GL_FRAGMENT_SHADER, kFragmentShader);
+  if (!vs || !fs) {
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return false;
+  }
+  program = glCreateProgram();
+  glAttachShader(program, vs);
+  glAttachShader(program, fs);
+  glBindAttribLocation(program, 0, "aPos");
+  glBindAttribLocation(program, 1, "aUv");
+  glBindAttribLocation(program, 2, "aColor");
+  glLinkProgram(program);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+
+  GLint ok = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    std::cerr << "Shader link failed\n";
+    return false;
+  }
+  glUseProgram(program);
+  viewUniform = glGetUniformLocation(program, "uView");
+  glUniform1i(glGetUniformLocation(program, "uAtlas"), 0);
+  return true;
+}
+
+// Expands the console's 1bpp font into an alpha texture, 16 glyphs per row,
+// plus one fully set cell after the last glyph for solid quads.
+void GlRenderer::initAtlas(const ConsoleFont& font) {
+  cellWidth = font.tileWidth;
+  cellHeight = font.tileHeight;
+  firstChar = font.asciiOffset;
+  charCount = font.numChars;
+  atlasColumns = 16;
+  atlasRows = (charCount + 1 + atlasColumns - 1) / atlasColumns;
+
+  int texWidth = atlasColumns * cellWidth;
+  int texHeight = atlasRows * cellHeight;
+  std::vector<unsigned char> pixels(texWidth * texHeight, 0);
+
+  // One 16-bit row per scanline, leftmost pixel in the top bit.
+  const u16* rows = static_cast<const u16*>(font.gfx);
+  for (unsigned c = 0; c <= charCount; ++c) {
+    int ox = (c % atlasColumns) * cellWidth;
+    int oy = (c / atlasColumns) * cellHeight;
+    for (int y = 0; y < cellHeight; ++y) {
+      u16 bits = c < charCount ? rows[c * cellHeight + y] : 0xFFFF;
+      for (int x = 0; x < cellWidth; ++x) {
+        if (bits & (0x8000 >> x))
+          pixels[(oy + y) * texWidth + ox + x] = 0xFF;
+      }
+    }
+  }
+
+  glGenTextures(1, &atlas);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, texWidth, texHeight, 0, GL_ALPHA,
+               GL_UNSIGNED_BYTE, pixels.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+bool GlRenderer::init(NWindow* window) {
+  const ConsoleFont& font = consoleGetDefault()->font;
+  if (font.tileWidth == 0 || font.tileWidth > 16 || font.tileHeight == 0)
+    return false;
+  if (!initEgl(window) || !initProgram())
+    return false;
+  initAtlas(font);
+
+  gridColumns = kFramebufferWidth / cellWidth;
+  gridRows = kFramebufferHeight / cellHeight;
+
+  // Worst case: a glyph in every cell plus a highlight or a two-part gauge
+  // on every row.
+  size_t maxQuads = gridRows * (gridColumns + 2);
+  vertices.resize(maxQuads * 6);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), nullptr,
+               GL_DYNAMIC_DRAW);
+
+  const GLsizei stride = sizeof(Vertex);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+                        reinterpret_cast<const void*>(offsetof(Vertex, x)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                        reinterpret_cast<const void*>(offsetof(Vertex, u)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride,
+                        reinterpret_cast<const void*>(offsetof(Vertex, r)));
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glViewport(0, 0, kFramebufferWidth, kFramebufferHeight);
+  glUniform2f(viewUniform, kFramebufferWidth, kFramebufferHeight);
+  return true;
+}
+
+void GlRenderer::quad(float x, float y, float w, float h, float u0, float v0,
+                      float u1, float v1, const float* c) {
+  if (used + 6 > vertices.size())
+    return;
+  Vertex* v = &vertices[used];
+  v[0] = {x, y, u0, v0, c[0], c[1], c[2], c[3]};
+  v[1] = {x + w, y, u1, v0, c[0], c[1], c[2], c[3]};
+  v[2] = {x, y + h, u0, v1, c[0], c[1], c[2], c[3]};
+  v[3] = v[1];
+  v[4] = {x + w, y + h, u1, v1, c[0], c[1], c[2], c[3]};
+  v[5] = v[2];
+  used += 6;
+}
+
+void GlRenderer::glyph(int row, int column, unsigned char c,
+                       const float* color) {
+  if (c < firstChar || c - firstChar >= charCount)
+    return;
+  unsigned index = c - firstChar;
+  float du = 1.0f / atlasColumns;
+  float dv = 1.0f / atlasRows;
+  float u = (index % atlasColumns) * du;
+  float v = (index / atlasColumns) * dv;
+  quad(column * cellWidth, row * cellHeight, cellWidth, cellHeight, u, v,
+       u + du, v + dv, color);
+}
+
+void GlRenderer::solid(float x, float y, float w, float h,
+                       const float* color) {
+  // Sample the middle of the solid cell so filtering never reaches a glyph.
+  float u = (charCount % atlasColumns + 0.5f) / atlasColumns;
+  float v = (charCount / atlasColumns + 0.5f) / atlasRows;
+  quad(x, y, w, h, u, v, u, v, color);
+}
+
+void GlRenderer::draw(const std::vector<std::string>& lines,
+                      const std::vector<Gauge>& gauges) {
+  used = 0;
+
+  // Backgrounds first so the text blends over them.
+  for (int r = 0; r < gridRows && r < (int)lines.size(); ++r) {
+    if (lines[r].compare(0, 2, "> ") == 0)
+      solid(0, r * cellHeight, gridColumns * cellWidth, cellHeight, kSelection);
+  }
+  for (const Gauge& g : gauges) {
+    float x = g.column * cellWidth;
+    float y = g.row * cellHeight + cellHeight / 4;
+    float w = g.width * cellWidth;
+    float h = cellHeight / 2;
+    solid(x, y, w, h, kGaugeTrack);
+    solid(x, y, w * g.fraction, h, kGaugeFill);
+  }
+
+  for (int r = 0; r < gridRows && r < (int)lines.size(); ++r) {
+    const std::string& l = lines[r];
+    const float* color = r == 0 ? kHeader : kText;
+    int n = l.size() < (size_t)gridColumns ? l.size() : gridColumns;
+    for (int c = 0; c < n; ++c) {
+      if (l[c] == ' ')
+        continue;
+      // Gauge cells hold the console rendering of the bar; skip them.
+      bool covered = false;
+      for (const Gauge& g : gauges) {
+        if (g.row == r && c >= g.column && c < g.column + g.width) {
+          covered = true;
+          break;
+        }
+      }
+      if (!covered)
+        glyph(r, c, l[c], color);
+    }
+  }
+
+  glClearColor(kBackground[0], kBackground[1], kBackground[2], kBackground[3]);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, used * sizeof(Vertex), vertices.data());
+  glDrawArrays(GL_TRIANGLES, 0, used);
+  eglSwapBuffers(display, surface);
+}
+
+#endif // NRL_GL_UI
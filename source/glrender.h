@@ -0,0 +1,79 @@
+#ifndef GLRENDER_H
+#define GLRENDER_H
+
+#ifdef NRL_GL_UI
+
+#include <switch.h>
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <string>
+#include <vector>
+
+#include "screen.h"
+
+// -------------------- GPU Text Renderer --------------------
+
+// Draws a Screen's character grid with OpenGL ES 2 instead of the software
+// console. Every glyph of the console font sits in one atlas texture, and a
+// frame is one draw call over a vertex buffer sized for a full grid at init,
+// so drawing allocates nothing. Selected rows ("> ") get a highlight bar and
+// gauges are drawn as solid bars rather than '=' cells.
+class GlRenderer {
+public:
+  GlRenderer() = default;
+  ~GlRenderer();
+
+  GlRenderer(const GlRenderer&) = delete;
+  GlRenderer& operator=(const GlRenderer&) = delete;
+
+  // Brings up EGL on `window` and uploads the font; false when any step
+  // fails, after which the console should be used instead.
+  bool init(NWindow* window);
+
+  int columns() const { return gridColumns; }
+  int rows() const { return gridRows; }
+
+  void draw(const std::vector<std::string>& lines,
+            const std::vector<Gauge>& gauges);
+
+private:
+  struct Vertex {
+    float x, y;
+    float u, v;
+    float r, g, b, a;
+  };
+
+  bool initEgl(NWindow* window);
+  bool initProgram();
+  void initAtlas(const ConsoleFont& font);
+  void quad(float x, float y, float w, float h, float u0, float v0, float u1,
+            float v1, const float* color);
+  void glyph(int row, int column, unsigned char c, const float* color);
+  void solid(float x, float y, float w, float h, const float* color);
+
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLSurface surface = EGL_NO_SURFACE;
+  EGLContext context = EGL_NO_CONTEXT;
+  GLuint program = 0;
+  GLuint atlas = 0;
+  GLuint vbo = 0;
+  GLint viewUniform = -1;
+
+  int gridColumns = 0;
+  int gridRows = 0;
+  int cellWidth = 0;
+  int cellHeight = 0;
+  unsigned firstChar = 0;
+  unsigned charCount = 0;
+  // Atlas size in cells: the glyphs, then one solid cell for bars.
+  int atlasColumns = 0;
+  int atlasRows = 0;
+
+  std::vector<Vertex> vertices; // sized once in init()
+  size_t used = 0;
+};
+
+#endif // NRL_GL_UI
+
+#endif // GLRENDER_H
@@ -0,0 +1,81 @@
+#include <iostream>
+
+#include "keyboard.h"
+
+// -------------------- Inline Keyboard --------------------
+
+InlineKeyboard* InlineKeyboard::active = nullptr;
+
+InlineKeyboard::~InlineKeyboard() {
+  if (!launched)
+    return;
+  swkbdInlineClose(&kbd);
+  active = nullptr;
+}
+
+bool InlineKeyboard::open() {
+  if (launched)
+    return true;
+  if (active || R_FAILED(swkbdInlineCreate(&kbd)))
+    return false;
+  Result rc = swkbdInlineLaunchForLibraryApplet(
+      &kbd, SwkbdInlineMode_AppletDisplay, 0);
+  if (R_FAILED(rc)) {
+    std::cerr << "Keyboard launch failed: 0x" << std::hex << rc << std::dec
+              << "\n";
+    swkbdInlineClose(&kbd);
+    return false;
+  }
+  swkbdInlineSetChangedStringCallback(&kbd, changedCallback);
+  swkbdInlineSetDecidedEnterCallback(&kbd, enteredCallback);
+  swkbdInlineSetDecidedCancelCallback(&kbd, canceledCallback);
+  launched = true;
+  active = this;
+  return true;
+}
+
+void InlineKeyboard::show(const std::string& text) {
+  if (!launched || shown)
+    return;
+  current = text;
+  SwkbdAppearArg arg;
+  swkbdInlineMakeAppearArg(&arg, SwkbdType_Normal);
+  swkbdInlineAppearArgSetOkButtonText(&arg, "Done");
+  swkbdInlineSetInputText(&kbd, text.c_str());
+  swkbdInlineSetCursorPos(&kbd, text.size());
+  swkbdInlineAppear(&kbd, &arg);
+  shown = true;
+}
+
+InlineKeyboard::Event InlineKeyboard::update() {
+  if (!launched)
+    return Event::None;
+  pending = Event::None;
+  swkbdInlineUpdate(&kbd, nullptr);
+  return pending;
+}
+
+void InlineKeyboard::changedCallback(const char* str,
+                                     SwkbdChangedStringArg* arg) {
+  if (!active)
+    return;
+  active->current = str;
+  if (active->pending == Event::None)
+    active->pending = Event::Changed;
+}
+
+void InlineKeyboard::enteredCallback(const char* str,
+                                     SwkbdDecidedEnterArg* arg) {
+  if (!active)
+    return;
+  active->current = str;
+  active->pending = Event::Entered;
+  active->shown = false;
+}
+
+void InlineKeyboard::canceledCallback() {
+  if (!active)
+    return;
+  active->pending = Event::Canceled;
+  active->shown = false;
+}
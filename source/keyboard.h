@@ -0,0 +1,53 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <switch.h>
+
+#include <string>
+
+// -------------------- Inline Keyboard --------------------
+
+// The system keyboard, drawn by its applet over the lower part of the
+// screen while the app keeps running and drawing above it. Unlike the
+// full-screen keyboard it reports the text after every keystroke. Only one
+// may be open at a time; it takes the pad input while shown.
+class InlineKeyboard {
+public:
+  enum class Event { None, Changed, Entered, Canceled };
+
+  InlineKeyboard() = default;
+  ~InlineKeyboard();
+
+  InlineKeyboard(const InlineKeyboard&) = delete;
+  InlineKeyboard& operator=(const InlineKeyboard&) = delete;
+
+  // Starts the keyboard applet; false when it is unavailable (e.g. when
+  // running as an applet without the memory for it).
+  bool open();
+
+  // Slides the keyboard in with `text` already typed.
+  void show(const std::string& text);
+  bool isShown() const { return shown; }
+
+  // Runs the applet for one frame and reports what happened in it; call
+  // once per loop iteration while open, shown or not.
+  Event update();
+
+  const std::string& text() const { return current; }
+
+private:
+  static void changedCallback(const char* str, SwkbdChangedStringArg* arg);
+  static void enteredCallback(const char* str, SwkbdDecidedEnterArg* arg);
+  static void canceledCallback();
+
+  // The callbacks carry no context; they report to the open keyboard.
+  static InlineKeyboard* active;
+
+  SwkbdInline kbd;
+  bool launched = false;
+  bool shown = false;
+  Event pending = Event::None;
+  std::string current;
+};
+
+#endif // KEYBOARD_H
@@ -0,0 +1,33 @@
+#include <switch.h>
+
+#include <iostream>
+#include <strings.h>
+
+#include "launch.h"
+
+// -------------------- Launching --------------------
+
+bool isNroPath(const std::string& path) {
+  if (path.size() < 4)
+    return false;
+  return strcasecmp(path.c_str() + path.size() - 4, ".nro") == 0;
+}
+
+bool canLaunchNro() {
+  return envHasNextLoad();
+}
+
+bool launchNro(const std::string& path) {
+  if (!canLaunchNro()) {
+    std::cerr << "Launching requires hbmenu\n";
+    return false;
+  }
+  // hbmenu passes the program's own path as argv[0].
+  std::string argv = "\"" + path + "\"";
+  Result rc = envSetNextLoad(path.c_str(), argv.c_str());
+  if (R_FAILED(rc)) {
+    std::cerr << "envSetNextLoad failed: " << rc << "\n";
+    return false;
+  }
+  return true;
+}
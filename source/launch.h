@@ -0,0 +1,18 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <string>
+
+// -------------------- Launching --------------------
+
+bool isNroPath(const std::string& path);
+
+// Whether the loader that started us accepts a next program; hbmenu's
+// hbloader does.
+bool canLaunchNro();
+
+// Asks hbloader to start `path` once this program exits. The caller should
+// leave its main loop straight away.
+bool launchNro(const std::string& path);
+
+#endif // LAUNCH_H
@@ -1,9 +1,10 @@
 #include <switch.h>
 #include <curl/curl.h>
-#include <jansson.h>
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <thread>
 #include <atomic>
@@ -14,498 +15,744 @@
 #include <algorithm>
 #include <cstring>
 #include <dirent.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <errno.h>
 
+#include "applet.h"
+#include "cache.h"
+#include "details.h"
+#include "download.h"
+#include "frames.h"
+#include "keyboard.h"
+#include "launch.h"
+#include "model.h"
+#include "net.h"
+#include "platform.h"
+#include "prefetch.h"
+#include "releases.h"
+#include "screen.h"
+#include "search.h"
+#include "sources.h"
+#include "startup.h"
+#include "store.h"
 #include "token.h"
+#include "transfers.h"
 
-// -------------------- Model Types --------------------
+// -------------------- UI Helpers --------------------
 
-struct Asset {
-  std::string name;
-  std::string url;
-};
-
-struct Release {
-  std::string tag;
-  std::string name;
-  std::string createdAt;
-  std::string commitId;
-  std::string description;
-  std::vector<Asset> assets;
-};
-
-// -------------------- CURL RAII Helpers --------------------
-
-class CurlGlobal {
-public:
-  CurlGlobal() { curl_global_init(CURL_GLOBAL_ALL); }
-  ~CurlGlobal() { curl_global_cleanup(); }
-};
-
-class CurlEasy {
-public:
-  CurlEasy() : handle(curl_easy_init()) {
-    if (!handle) {
-      std::cerr << "CURL init failed\n";
-      std::exit(1);
-    }
-  }
+static int runMenu(Screen& screen, const std::vector<std::string_view>& items,
+                   std::string_view title) {
+  int sel = 0;
+  Viewport view;
+  PadState pad;
 
-  ~CurlEasy() {
-    if (handle)
-      curl_easy_cleanup(handle);
-  }
+  padInitializeDefault(&pad);
+  padConfigureInput(1, HidNpadStyleSet_NpadStandard);
 
-  void setopt(CURLoption opt, const char* v) {
-    curl_easy_setopt(handle, opt, v);
-  }
+  // Only the rows that fit are drawn; the list scrolls under the title.
+  auto draw = [&]() {
+    int visible = screen.rows() - 2;
+    view.follow(sel, items.size(), visible);
+    screen.clear();
+    screen.print(0, title);
+    for (int i = 0; i < visible && view.top + i < (int)items.size(); ++i) {
+      std::string& l = screen.line(i + 2);
+      l = view.top + i == sel ? "> " : "  ";
+      l += items[view.top + i];
+    }
+    screen.present();
+  };
+  draw();
 
-  void setopt(CURLoption opt, struct curl_slist* v) {
-    curl_easy_setopt(handle, opt, v);
-  }
+  while (appletMainLoop()) {
+    padUpdate(&pad);
+    u64 btn = padGetButtonsDown(&pad);
+    int prev_sel = sel;
 
-  void setopt(CURLoption opt, long v) {
-    curl_easy_setopt(handle, opt, v);
-  }
+    if (btn & HidNpadButton_Down)
+      sel = (sel + 1) % items.size();
+    if (btn & HidNpadButton_Up)
+      sel = (sel - 1 + items.size()) % items.size();
+    if (btn & HidNpadButton_A)
+      return sel;
+    if (btn & HidNpadButton_B)
+      return -1;
 
-  void performOrExit() {
-    CURLcode res = curl_easy_perform(handle);
-    if (res != CURLE_OK) {
-      std::cerr << "CURL error: " << curl_easy_strerror(res) << "\n";
-      std::exit(1);
-    }
-  }
+    if (btn)
+      FrameScheduler::get().markActive();
+    if (sel != prev_sel)
+      draw();
 
-  long getResponseCode() const {
-    long code = 0;
-    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
-    return code;
+    FrameScheduler::get().wait();
   }
 
-  CURL* getHandle() const { return handle; }
-
-private:
-  CURL* handle = nullptr;
-};
+  return -1;
+}
 
-// -------------------- Memory Buffer for CURL --------------------
+// An .nro, or an archive that may contain one.
+static bool isLaunchable(const Asset& a) {
+  return isNroPath(downloadFileName(a)) || isArtifactArchive(a);
+}
 
-class MemoryBuffer {
-public:
-  static size_t WriteCallback(void* ptr, size_t size, size_t nmemb, void* userdata) {
-    auto* self = static_cast<MemoryBuffer*>(userdata);
-    self->data.append(static_cast<char*>(ptr), size * nmemb);
-    return size * nmemb;
+// `detail` is nullptr while it is still being fetched. `project` is empty
+// when only one source is listed.
+static void displayRelease(Screen& screen, const Release& r,
+                           std::string_view project,
+                           const ReleaseDetail* detail, int idx, int total,
+                           const std::string& status,
+                           const std::string& downloads, bool prefetch) {
+  screen.clear();
+  int row = 0;
+  std::string& header = screen.line(row++);
+  header = "Release " + std::to_string(idx + 1) + " of " + std::to_string(total);
+  if (!status.empty())
+    header += " (" + status + ")";
+  if (!downloads.empty())
+    screen.print(row++, downloads);
+  ++row;
+
+  if (!project.empty()) {
+    std::string& label = screen.line(row++);
+    label = "Project: ";
+    label += project;
   }
+  std::string& tag = screen.line(row++);
+  tag = "Tag:    ";
+  tag += r.tag;
+  std::string& name = screen.line(row++);
+  name = "Name:   ";
+  name += r.name;
+  std::string& commit = screen.line(row++);
+  commit = "Commit: ";
+  commit += r.commitId;
+  std::string& date = screen.line(row++);
+  date = "Date:   ";
+  date += r.createdAt;
+  ++row;
+
+  // The key hints keep the bottom rows; the description gets the rest.
+  int footer = screen.rows() - 3;
+  if (!detail) {
+    screen.print(row, "Loading details...");
+  } else {
+    bool clipped = false;
+    int end = screen.wrap(row, detail->description, footer - 1, &clipped);
+    if (clipped)
+      screen.print(end - 1, "...");
+  }
+  bool launchable = false;
+  if (detail) {
+    for (auto& a : detail->assets)
+      launchable = launchable || isLaunchable(a);
+  }
+  if (detail && detail->assets.empty())
+    screen.print(footer, "No assets available for this release.");
+  std::string& keys = screen.line(footer + 1);
+  keys = "Press ";
+  if (launchable)
+    keys += "A to launch, ";
+  if (detail && !detail->assets.empty())
+    keys += "X to queue assets, ";
+  keys += "Y for downloads, [+] to exit.";
+  screen.print(footer + 2, prefetch ? "[-] background prefetch: on, R to search"
+                                    : "[-] background prefetch: off, R to search");
+  screen.present();
+}
 
-  std::string data;
-};
+// -------------------- Download Queue View --------------------
+
+// Speed limits cycled with ZL/ZR; 0 is unlimited.
+static const curl_off_t kBandwidthCaps[] = {0, 256 * 1024, 1024 * 1024,
+                                            4 * 1024 * 1024, 16 * 1024 * 1024};
+static const int kBandwidthCapCount =
+    sizeof(kBandwidthCaps) / sizeof(kBandwidthCaps[0]);
+static const int kMaxParallelDownloads = 4;
+
+static std::string formatBytes(curl_off_t n) {
+  char buf[32];
+  if (n >= 1024 * 1024)
+    snprintf(buf, sizeof(buf), "%.1f MB", n / (1024.0 * 1024.0));
+  else
+    snprintf(buf, sizeof(buf), "%.1f KB", n / 1024.0);
+  return buf;
+}
 
-// -------------------- JSON Helpers --------------------
+static std::string bandwidthCapLabel(curl_off_t cap) {
+  return cap > 0 ? formatBytes(cap) + "/s" : "unlimited";
+}
 
-static std::string jsonGetString(json_t* obj, const char* key) {
-  if (!obj)
-    return {};
-  json_t* val = json_object_get(obj, key);
-  return json_is_string(val) ? json_string_value(val) : "";
+static std::string formatMs(int ms) {
+  return ms < 0 ? "-" : std::to_string(ms) + " ms";
 }
 
-static std::string urlEncodeProject(const std::string& path) {
-  std::string out;
-  for (char c : path) {
-    if (c == '/')
-      out += "%2F";
-    else
-      out += c;
+// Rows of the statistics overlay in the download view.
+static const int kStatsRows = 4;
+
+// Where the time of the selected transfer goes, to tell a slow server from
+// a slow network or SD card.
+static void drawStats(Screen& screen, int row, const DownloadInfo& d) {
+  const TransferStats& s = d.stats;
+  screen.print(row, "  Connection: dns " + formatMs(s.phases.dnsMs) +
+                        ", connect " + formatMs(s.phases.connectMs) +
+                        ", tls " + formatMs(s.phases.tlsMs) +
+                        ", first byte " + formatMs(s.phases.firstByteMs));
+  screen.print(row + 1, "  Speed: " + formatBytes(s.rate) + "/s now, " +
+                            formatBytes(s.avgRate) + "/s average, " +
+                            std::to_string(s.stalls) + " stalls");
+  screen.print(row + 2,
+               "  SD card: " + std::to_string(s.diskWrites.total()) +
+                   " writes, p50 " + formatMs(s.diskWrites.percentileMs(0.5)) +
+                   ", p99 " + formatMs(s.diskWrites.percentileMs(0.99)) + ", " +
+                   std::to_string(s.diskWaits) + " waits for buffers");
+  // Empty buckets are left out to fit the line.
+  std::string hist = "  Write ms:";
+  for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+    if (s.diskWrites.n[i] == 0)
+      continue;
+    int limit = LatencyHistogram::bucketLimitMs(i);
+    hist += " <" + (limit < 0 ? std::string("inf") : std::to_string(limit)) +
+            ":" + std::to_string(s.diskWrites.n[i]);
   }
-  return out;
+  screen.print(row + 3, hist);
 }
 
-// -------------------- Parse Releases from JSON --------------------
-
-static std::vector<Release> parseReleases(const std::string& rawJson) {
-  std::vector<Release> result;
-  json_error_t err;
-  json_t* root = json_loads(rawJson.c_str(), 0, &err);
-  if (!root) {
-    std::cerr << "JSON parse error: " << err.text << "\n";
-    return result;
-  }
+static bool endsWithNoCase(std::string_view s, std::string_view suffix) {
+  return s.size() >= suffix.size() &&
+         strncasecmp(s.data() + s.size() - suffix.size(), suffix.data(),
+                     suffix.size()) == 0;
+}
 
-  if (!json_is_array(root)) {
-    std::cerr << "Expected JSON array\n";
-    json_decref(root);
-    return result;
+// The published checksum for `a`: its "<asset>.sha256", else the release's
+// SHA256SUMS. Empty when the release has neither.
+static std::string checksumUrlFor(const ReleaseDetail& detail,
+                                  const Asset& a) {
+  std::string sums = std::string(a.name) + ".sha256";
+  std::string url;
+  for (auto& p : detail.assets) {
+    std::string name(p.name);
+    if (strcasecmp(name.c_str(), sums.c_str()) == 0)
+      return std::string(p.url);
+    if (strcasecmp(name.c_str(), "SHA256SUMS") == 0 && url.empty())
+      url = std::string(p.url);
   }
+  return url;
+}
 
-  size_t idx;
-  json_t* item;
-  json_array_foreach(root, idx, item) {
-    Release r;
-    r.tag       = jsonGetString(item, "tag_name");
-    r.name      = jsonGetString(item, "name");
-    r.createdAt = jsonGetString(item, "created_at");
-
-    json_t* commitObj = json_object_get(item, "commit");
-    if (json_is_object(commitObj)) {
-      r.commitId = jsonGetString(commitObj, "short_id");
-    }
-
-    json_t* assetsObj = json_object_get(item, "assets");
-    if (json_is_object(assetsObj)) {
-      json_t* links = json_object_get(assetsObj, "links");
-      if (json_is_array(links)) {
-        size_t ai;
-        json_t* linkItem;
-        json_array_foreach(links, ai, linkItem) {
-          Asset a;
-          a.name = jsonGetString(linkItem, "name");
-          a.url = jsonGetString(linkItem, "direct_asset_url");
-          if (a.url.empty())
-            a.url = jsonGetString(linkItem, "url");
-          if (!a.name.empty() && !a.url.empty())
-            r.assets.push_back(a);
-        }
-      }
-
-      json_t* sources = json_object_get(assetsObj, "sources");
-      if (json_is_array(sources)) {
-        size_t si;
-        json_t* srcItem;
-        json_array_foreach(sources, si, srcItem) {
-          Asset a;
-          std::string fmt = jsonGetString(srcItem, "format");
-          a.name = "Source (" + fmt + ")";
-          a.url = jsonGetString(srcItem, "url");
-          if (!a.url.empty())
-            r.assets.push_back(a);
-        }
+// Looks for a bsdiff patch from a release whose copy of `a` we still have,
+// and a checksum to check the result against (see delta.h).
+static DeltaPlan planDelta(const Source& source, const ReleaseDetail& detail,
+                           const Asset& a) {
+  DeltaPlan plan;
+  std::string prefix = std::string(a.name) + "@";
+  for (auto& p : detail.assets) {
+    if (p.name.size() > prefix.size() && p.name.compare(0, prefix.size(),
+                                                        prefix) == 0 &&
+        endsWithNoCase(p.name, ".bsdiff") && plan.patchUrl.empty()) {
+      std::string_view from = p.name.substr(
+          prefix.size(), p.name.size() - prefix.size() - strlen(".bsdiff"));
+      std::string base =
+          ArtifactStore::get().find(source.storeTag(from), a.name);
+      if (!base.empty()) {
+        plan.patchUrl = resolveArtifactUrl(std::string(p.url));
+        plan.basePath = base;
       }
     }
-
-    result.push_back(std::move(r));
   }
-
-  json_decref(root);
-  return result;
+  plan.checksumUrl = checksumUrlFor(detail, a);
+  if (plan.checksumUrl.empty())
+    return DeltaPlan(); // no way to trust the patched file
+  plan.checksumName = std::string(a.name);
+  return plan;
 }
 
-// -------------------- Fetch Releases Over Network --------------------
-
-static std::vector<Release> fetchReleases(const std::string& apiUrl,
-                                          const std::string& token) {
-  MemoryBuffer buf;
-  CurlEasy curl;
-  struct curl_slist* headers = nullptr;
+// GitHub assets are fetched without credentials: the PRIVATE-TOKEN header
+// means nothing there, and the download redirects to another host.
+static DownloadRequest assetRequest(const Source& source, const Release& r,
+                                    const ReleaseDetail& detail,
+                                    const Asset& a) {
+  DownloadRequest req;
+  req.name = std::string(a.name);
+  req.url = resolveArtifactUrl(std::string(a.url));
+  if (!a.mirror.empty())
+    req.mirrors.push_back(resolveArtifactUrl(std::string(a.mirror)));
+  if (source.forge == Forge::GitLab)
+    req.token = source.token;
+  req.tag = source.storeTag(r.tag);
+  req.asset = std::string(a.name);
+  req.outPath = ArtifactStore::get().incomingPath(req.tag, req.asset);
+  // Job artifacts come as a zip; only the homebrew inside is worth keeping.
+  // Its entries are checked against their CRC-32 as they unpack instead.
+  if (isArtifactArchive(a)) {
+    req.extract.push_back(".nro");
+    req.name += " (.nro files)";
+  } else {
+    req.checksumUrl = checksumUrlFor(detail, a);
+    if (!req.checksumUrl.empty())
+      req.checksumName = std::string(a.name);
+    req.delta = planDelta(source, detail, a);
+    if (!req.delta.empty())
+      req.name += " (delta)";
+  }
+  return req;
+}
 
-  if (!token.empty()) {
-    headers = curl_slist_append(headers, ("PRIVATE-TOKEN: " + token).c_str());
+// One-line summary for the release view; empty when the queue is idle.
+static std::string downloadSummary(const DownloadManager& downloads) {
+  int active = 0, queued = 0;
+  for (auto& d : downloads.list()) {
+    active += d.status == DownloadStatus::Active;
+    queued += d.status == DownloadStatus::Queued;
   }
-  headers = curl_slist_append(headers, "Accept: application/json");
-
-  curl.setopt(CURLOPT_HTTPHEADER, headers);
-  curl.setopt(CURLOPT_URL, apiUrl.c_str());
-  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEFUNCTION,
-                   MemoryBuffer::WriteCallback);
-  curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEDATA, &buf);
-  curl.setopt(CURLOPT_FOLLOWLOCATION, 1L);
-  curl.performOrExit();
-
-  long code = curl.getResponseCode();
-  if (headers)
-    curl_slist_free_all(headers);
-
-  if (code != 200) {
-    std::cerr << "HTTP error: " << code << "\n";
+  if (active == 0 && queued == 0)
     return {};
-  }
+  return "Downloads: " + std::to_string(active) + " active, " +
+         std::to_string(queued) + " queued";
+}
 
-  return parseReleases(buf.data);
+static bool findDownload(const DownloadManager& downloads, int id,
+                         DownloadInfo& out) {
+  for (auto& d : downloads.list()) {
+    if (d.id == id) {
+      out = d;
+      return true;
+    }
+  }
+  return false;
 }
 
-// -------------------- UI Helpers --------------------
+static void drawDownloads(Screen& screen, const DownloadManager& downloads,
+                          const std::vector<DownloadInfo>& items, int sel,
+                          Viewport& view, bool stats) {
+  screen.clear();
+  screen.print(0, "Downloads (" + std::to_string(downloads.maxActive()) +
+                      " at a time, limit " +
+                      bandwidthCapLabel(downloads.bandwidthCap()) + ")");
+
+  // Two rows per entry between the header and the key hints.
+  int visible = (screen.rows() - 5 - (stats ? kStatsRows : 0)) / 2;
+  view.follow(sel, items.size(), visible);
+  if (items.empty())
+    screen.print(2, "  Nothing queued.");
+  for (int i = 0; i < visible && view.top + i < (int)items.size(); ++i) {
+    const DownloadInfo& d = items[view.top + i];
+    std::string& title = screen.line(2 + i * 2);
+    title = view.top + i == sel ? "> " : "  ";
+    title += d.name;
+
+    double progress = d.total > 0 ? static_cast<double>(d.now) / d.total : 0.0;
+    if (d.status == DownloadStatus::Done)
+      progress = 1.0;
+    int row = 3 + i * 2;
+    screen.print(row, "    [");
+    screen.gauge(row, 5, 30, progress);
+    std::string& bar = screen.line(row);
+    char pct[16];
+    snprintf(pct, sizeof(pct), "] %5.1f%% ", progress * 100.0);
+    bar += pct;
+    bar += formatBytes(d.now);
+    if (d.total > 0)
+      bar += " / " + formatBytes(d.total);
+    bar += "  ";
+    bar += downloadStatusName(d.status);
+    bar += ", ";
+    bar += downloadPriorityName(d.priority);
+    if (d.resumable && d.status != DownloadStatus::Done)
+      bar += ", resumable";
+    if (d.background)
+      bar += ", prefetch";
+    if (d.verdict != DownloadVerdict::Unchecked) {
+      bar += ", ";
+      bar += downloadVerdictName(d.verdict);
+    }
+  }
+  if (stats && sel < (int)items.size())
+    drawStats(screen, screen.rows() - 3 - kStatsRows, items[sel]);
+
+  screen.print(screen.rows() - 2,
+               "Up/Down select, L/R priority, [-] cancel, A retry, [+] stats");
+  screen.print(screen.rows() - 1,
+               "X parallel jobs, ZL/ZR speed limit, Y clear finished, B back");
+  screen.present();
+}
 
-static int runMenu(const std::vector<std::string>& items,
-                   const std::string& title) {
-  int sel = 0;
+static void showDownloads(Screen& screen, DownloadManager& downloads) {
   PadState pad;
-
   padInitializeDefault(&pad);
   padConfigureInput(1, HidNpadStyleSet_NpadStandard);
 
-  consoleClear();
-  std::cout << title << "\n\n";
-  for (int i = 0; i < (int)items.size(); ++i) {
-    std::cout << (i == sel ? "> " : "  ") << items[i] << "\n";
+  int sel = 0;
+  Viewport view;
+  int capIndex = 0;
+  for (int i = 0; i < kBandwidthCapCount; ++i) {
+    if (kBandwidthCaps[i] == downloads.bandwidthCap())
+      capIndex = i;
   }
-  consoleUpdate(nullptr);
 
+  // Progress changes on its own; the frame is rebuilt whenever the queue
+  // differs from what is on screen, at most once per frame.
+  std::vector<DownloadInfo> drawn;
+  bool first = true;
+  bool stats = false;
   while (appletMainLoop()) {
     padUpdate(&pad);
     u64 btn = padGetButtonsDown(&pad);
-    int prev_sel = sel;
-
-    if (btn & HidNpadButton_Down)
-      sel = (sel + 1) % items.size();
-    if (btn & HidNpadButton_Up)
-      sel = (sel - 1 + items.size()) % items.size();
-    if (btn & HidNpadButton_A)
-      return sel;
     if (btn & HidNpadButton_B)
-      return -1;
-
-    if (sel != prev_sel) {
-      consoleClear();
-      std::cout << title << "\n\n";
-      for (int i = 0; i < (int)items.size(); ++i) {
-        std::cout << (i == sel ? "> " : "  ") << items[i] << "\n";
-      }
-      consoleUpdate(nullptr);
+      break;
+    if (btn)
+      FrameScheduler::get().markActive();
+
+    std::vector<DownloadInfo> items = downloads.list();
+    int count = items.size();
+    if (count > 0) {
+      if (btn & HidNpadButton_Down)
+        sel = (sel + 1) % count;
+      if (btn & HidNpadButton_Up)
+        sel = (sel - 1 + count) % count;
+      if (sel >= count)
+        sel = count - 1;
+
+      const DownloadInfo& d = items[sel];
+      if ((btn & HidNpadButton_R) && d.priority != DownloadPriority::High)
+        downloads.setPriority(d.id, DownloadPriority((int)d.priority + 1));
+      if ((btn & HidNpadButton_L) && d.priority != DownloadPriority::Low)
+        downloads.setPriority(d.id, DownloadPriority((int)d.priority - 1));
+      if (btn & HidNpadButton_Minus)
+        downloads.cancel(d.id);
+      if (btn & HidNpadButton_A)
+        downloads.retry(d.id);
     }
-
-    svcSleepThread(50'000'000ULL);
+    if (btn & HidNpadButton_Y) {
+      downloads.clearFinished();
+      sel = 0;
+    }
+    if (btn & HidNpadButton_X)
+      downloads.setMaxActive(downloads.maxActive() % kMaxParallelDownloads + 1);
+    if (btn & HidNpadButton_ZR)
+      capIndex = (capIndex + 1) % kBandwidthCapCount;
+    if (btn & HidNpadButton_ZL)
+      capIndex = (capIndex - 1 + kBandwidthCapCount) % kBandwidthCapCount;
+    if (btn & (HidNpadButton_ZL | HidNpadButton_ZR))
+      downloads.setBandwidthCap(kBandwidthCaps[capIndex]);
+    if (btn & HidNpadButton_Plus)
+      stats = !stats;
+
+    if (btn)
+      items = downloads.list();
+    if (btn || first || items != drawn) {
+      drawDownloads(screen, downloads, items, sel, view, stats);
+      drawn.swap(items);
+      first = false;
+    }
+    FrameScheduler::get().wait();
   }
-
-  return -1;
 }
 
-static void displayRelease(const Release& r, int idx, int total) {
-  consoleClear();
-  std::cout << "Release " << (idx + 1) << " of " << total << "\n\n"
-            << "Tag:    " << r.tag << "\n"
-            << "Name:   " << r.name << "\n"
-            << "Commit: " << r.commitId << "\n"
-            << "Date:   " << r.createdAt << "\n\n"
-            << r.description << "\n\n";
-
-  if (!r.assets.empty()) {
-    std::cout << "Press X for assets, [+] to exit.\n";
-  } else {
-    std::cout << "No assets available for this release.\n"
-              << "Press [+] to continue.\n";
+// -------------------- Search View --------------------
+
+// `typing`: the keyboard covers the lower half of the screen.
+static void drawSearch(Screen& screen, const std::vector<Release>& releases,
+                       const std::vector<uint32_t>& hits, int sel,
+                       Viewport& view, const std::string& query, bool nroOnly,
+                       bool close, bool typing) {
+  screen.clear();
+  screen.print(0, "Search: " + query + (typing ? "_" : ""));
+  std::string& summary = screen.line(1);
+  summary = std::to_string(hits.size()) + " of " +
+            std::to_string(releases.size()) + " releases";
+  if (close)
+    summary += ", no exact match; closest shown";
+  if (nroOnly)
+    summary += ", with NRO only";
+
+  int rows = typing ? screen.rows() / 2 : screen.rows() - 2;
+  int visible = rows - 3;
+  view.follow(sel, hits.size(), visible);
+  for (int i = 0; i < visible && view.top + i < (int)hits.size(); ++i) {
+    const Release& r = releases[hits[view.top + i]];
+    std::string& l = screen.line(3 + i);
+    l = view.top + i == sel && !typing ? "> " : "  ";
+    l += r.tag;
+    l += "  ";
+    l += r.name;
+    l += "  ";
+    l += r.createdAt.substr(0, 10);
   }
-  consoleUpdate(nullptr);
-}
-
-// -------------------- Download Asset --------------------
-
-struct DownloadCallbackData {
-  std::atomic<bool>* canceled_ptr;
-  std::atomic<curl_off_t>* dl_total_ptr;
-  std::atomic<curl_off_t>* dl_now_ptr;
-};
-
-static int curlXferInfoCallback(void* clientp, curl_off_t dltotal,
-                                curl_off_t dlnow, curl_off_t, curl_off_t) {
-  auto* cb = static_cast<DownloadCallbackData*>(clientp);
-  cb->dl_total_ptr->store(dltotal);
-  cb->dl_now_ptr->store(dlnow);
-  return cb->canceled_ptr->load() ? 1 : 0;
-}
-
-static void ensure_downloads_directory() {
-  if (mkdir("sdmc:/downloads", 0777) != 0 && errno != EEXIST) {
-    std::cerr << "Error creating downloads directory: " << errno << "\n";
+  if (!typing) {
+    screen.print(screen.rows() - 2,
+                 "Up/Down select, A open, R edit, L NRO only, B back");
+    screen.print(screen.rows() - 1,
+                 "Filters: since:2024-01 until:2024-06-30 has:nro");
   }
+  screen.present();
 }
 
-static void downloadAsset(const Asset& a, const std::string& token) {
-  std::atomic<bool> done{false};
-  std::atomic<bool> canceled{false};
-  std::atomic<curl_off_t> dl_total{0};
-  std::atomic<curl_off_t> dl_now{0};
-  DownloadCallbackData cb{&canceled, &dl_total, &dl_now};
-
-  // Prepare filename
-  std::string filename = a.url.substr(a.url.find_last_of('/') + 1);
-  if (filename.empty())
-    filename = a.name;
-  size_t qm = filename.find('?');
-  if (qm != std::string::npos)
-    filename.resize(qm);
-  for (char& c : filename) {
-    if (std::string("\\/:*?\"<>|").find(c) != std::string::npos)
-      c = '_';
-  }
+// Returns the index of the release picked, or -1. `query` is kept for the
+// next search.
+static int runSearch(Screen& screen, const std::vector<Release>& releases,
+                     const ReleaseIndex& index, std::string& query) {
+  PadState pad;
+  padInitializeDefault(&pad);
+  padConfigureInput(1, HidNpadStyleSet_NpadStandard);
 
-  std::thread td([&]() {
-    CurlEasy curl;
-    struct curl_slist* headers = nullptr;
-    if (!token.empty()) {
-      headers = curl_slist_append(headers,
-                                  ("PRIVATE-TOKEN: " + token).c_str());
-      curl.setopt(CURLOPT_HTTPHEADER, headers);
-    }
+  InlineKeyboard keyboard;
+  bool haveKeyboard = keyboard.open();
+  if (haveKeyboard)
+    keyboard.show(query);
 
-    std::string url = a.url;
-    size_t jobs = url.find("/-/jobs/");
-    if (jobs != std::string::npos) {
-      size_t scheme_end = url.find("//") + 2;
-      size_t domain_end = url.find('/', scheme_end);
-      if (domain_end != std::string::npos && domain_end < jobs) {
-        std::string domain = url.substr(0, domain_end);
-        std::string project = url.substr(domain_end + 1, jobs - domain_end - 1);
-        size_t id_start = jobs + strlen("/-/jobs/");
-        size_t id_end = url.find('/', id_start);
-        std::string jobId = url.substr(id_start, id_end - id_start);
-        size_t art = url.find("/artifacts/", id_end);
-        if (art != std::string::npos) {
-          std::string rest = url.substr(art + strlen("/artifacts/"));
-          const std::string rawPrefix = "raw/";
-          if (rest.rfind(rawPrefix, 0) == 0)
-            rest = rest.substr(rawPrefix.size());
-          url = domain + "/api/v4/projects/" + urlEncodeProject(project) + "/jobs/" + jobId + "/artifacts/" + rest;
-        }
+  std::vector<uint32_t> hits;
+  bool nroOnly = false;
+  bool close = false;
+  int sel = 0;
+  Viewport view;
+  // Every keystroke reruns the whole query; the index keeps that well
+  // within a frame.
+  auto refresh = [&]() {
+    SearchQuery q = parseSearchQuery(query);
+    q.nroOnly = q.nroOnly || nroOnly;
+    close = index.search(q, hits);
+    sel = 0;
+    view = Viewport();
+  };
+  auto draw = [&]() {
+    drawSearch(screen, releases, hits, sel, view, query, nroOnly, close,
+               keyboard.isShown());
+  };
+  refresh();
+  draw();
+
+  int picked = -1;
+  while (appletMainLoop()) {
+    InlineKeyboard::Event ev = keyboard.update();
+    padUpdate(&pad);
+    u64 btn = padGetButtonsDown(&pad);
+    if (ev != InlineKeyboard::Event::None) {
+      if (query != keyboard.text()) {
+        query = keyboard.text();
+        refresh();
       }
+      draw();
+    }
+    // The keyboard has the pad while shown, including the press that
+    // closed it.
+    if (keyboard.isShown() || ev != InlineKeyboard::Event::None) {
+      FrameScheduler::get().markActive();
+      FrameScheduler::get().wait();
+      continue;
     }
 
-    curl.setopt(CURLOPT_URL, url.c_str());
-    curl.setopt(CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl.getHandle(), CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(curl.getHandle(), CURLOPT_XFERINFOFUNCTION,
-                     curlXferInfoCallback);
-    curl_easy_setopt(curl.getHandle(), CURLOPT_XFERINFODATA, &cb);
-
-    ensure_downloads_directory();
-    std::string out = "sdmc:/downloads/" + filename;
-    FILE* fp = fopen(out.c_str(), "wb");
-    if (!fp) {
-      std::cerr << "Failed to open " << out << "\n";
-      done = true;
-      if (headers)
-        curl_slist_free_all(headers);
-      return;
+    if (btn & HidNpadButton_B)
+      break;
+    if (btn)
+      FrameScheduler::get().markActive();
+    int count = hits.size();
+    if ((btn & HidNpadButton_A) && count > 0) {
+      picked = hits[sel];
+      break;
+    }
+    if ((btn & HidNpadButton_R) && haveKeyboard)
+      keyboard.show(query);
+    if (btn & HidNpadButton_L) {
+      nroOnly = !nroOnly;
+      refresh();
     }
+    if (count > 0 && (btn & HidNpadButton_Down))
+      sel = (sel + 1) % count;
+    if (count > 0 && (btn & HidNpadButton_Up))
+      sel = (sel - 1 + count) % count;
+    if (btn)
+      draw();
+    FrameScheduler::get().wait();
+  }
+  return picked;
+}
 
-    curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEFUNCTION, fwrite);
-    curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEDATA, fp);
-    CURLcode res = curl_easy_perform(curl.getHandle());
-    fclose(fp);
+// -------------------- Main --------------------
 
-    if (res != CURLE_OK || canceled)
-      remove(out.c_str());
+// Releases on each side of the shown one whose details are loaded ahead.
+static const int kDetailPrefetchRadius = 2;
 
-    done = true;
-    if (headers)
-      curl_slist_free_all(headers);
-  });
+// Shows `message` until [+] is pressed.
+static void showMessage(Screen& screen, std::string_view message) {
+  screen.clear();
+  screen.wrap(0, message, screen.rows());
+  screen.present();
 
   PadState pad;
   padInitializeDefault(&pad);
-  padConfigureInput(1, HidNpadStyleSet_NpadStandard);
-
-  consoleClear();
-  std::cout << "Downloading: " << a.name << "\nPress B to cancel.\n\n";
-  consoleUpdate(nullptr);
-
-  while (appletMainLoop() && !done) {
-    padUpdate(&pad);
-    if (padGetButtonsDown(&pad) & HidNpadButton_B)
-      canceled = true;
-
-    double progress =
-        dl_total > 0 ? static_cast<double>(dl_now) / dl_total : 0.0;
-    printf("\x1b[4;0H[");
-    int w = 50;
-    for (int i = 0; i < w; ++i)
-      printf(i < progress * w ? "=" : " ");
-    printf("] %.2f%%\n", progress * 100.0);
-
-    consoleUpdate(nullptr);
-    svcSleepThread(50'000'000ULL);
-  }
-
-  td.join();
-  consoleClear();
-
-  if (canceled) {
-    std::cout << "Download cancelled.\n";
-  } else if (dl_total > 0 && dl_now == dl_total) {
-    std::cout << "Successfully downloaded: " << a.name << "\n";
-  } else {
-    std::cout << "Download failed: " << a.name << "\n";
-  }
-
-  std::cout << "\nPress A to continue.\n";
-  consoleUpdate(nullptr);
-
   while (appletMainLoop()) {
     padUpdate(&pad);
-    if (padGetButtonsDown(&pad) & HidNpadButton_A)
+    if (padGetButtonsDown(&pad) & HidNpadButton_Plus)
       break;
-    svcSleepThread(50'000'000ULL);
+    FrameScheduler::get().wait();
   }
 }
 
-// -------------------- Main --------------------
-
 int main() {
-  consoleInit(nullptr);
+  StartupProfile& profile = StartupProfile::get();
+  // Everything draws through the shadow screen, on the console or the GPU.
+  Screen screen = Screen::open();
   padConfigureInput(1, HidNpadStyleSet_NpadStandard);
-  CurlGlobal curlInit;
-
-  if (R_FAILED(socketInitializeDefault())) {
-    std::cerr << "Socket init failed\n";
-    consoleExit(nullptr);
+  profile.mark("screen");
+
+  // Comes up on its own thread while the cached lists are drawn; only a
+  // cold start has to wait for it before there is anything to show.
+  NetworkSession network;
+
+  // Without a sources.txt the launcher follows its own project.
+  std::vector<Source> sources;
+  if (!loadSources(sources)) {
+    Source builtIn;
+    builtIn.apiUrl = "https://gitlab.your-ass-is.exposed/api/v4/projects/"
+                     "craftcore%2Fclient-engine/releases";
+    builtIn.token = GITLAB_PRIVATE_TOKEN;
+    if (builtIn.token.empty() ||
+        builtIn.token == "YOUR_ACTUAL_GITLAB_TOKEN_HERE") {
+      std::cerr << "Error: Missing GitLab token\n";
+      showMessage(screen, "Error: Missing GitLab token\nPress [+] to exit.");
+      return 1;
+    }
+    sources.push_back(std::move(builtIn));
+  }
+  if (sources.empty()) {
+    showMessage(screen, "No sources in sources.txt.\nPress [+] to exit.");
     return 1;
   }
-
-  nifmInitialize(NifmServiceType_User);
-  nxlinkStdio();
-
-  const std::string apiUrl =
-      "https://gitlab.your-ass-is.exposed/api/v4/projects/"
-      "craftcore%2Fclient-engine/releases";
-  const std::string token = GITLAB_PRIVATE_TOKEN;
-
-  if (token.empty() || token == "YOUR_ACTUAL_GITLAB_TOKEN_HERE") {
-    consoleClear();
-    std::cerr << "Error: Missing GitLab token\nPress [+] to exit.\n";
-    consoleUpdate(nullptr);
-
-    PadState pad;
-    padInitializeDefault(&pad);
-    while (appletMainLoop()) {
-      padUpdate(&pad);
-      if (padGetButtonsDown(&pad) & HidNpadButton_Plus)
-        break;
-      svcSleepThread(50'000'000ULL);
+  profile.mark("sources");
+
+  // Draw the cached lists straight away and revalidate them in the
+  // background; only a cold start has to wait for the network. Every
+  // source is fetched in the same round.
+  ReleaseFeed feed;
+  bool cached = false;
+  for (const Source& source : sources) {
+    ReleaseList sourceCache;
+    std::string etag;
+    if (loadReleaseCache(source.cachePath(), source.apiUrl, sourceCache,
+                         etag) &&
+        !sourceCache.releases.empty()) {
+      cached = true;
+    } else {
+      // Without the list a 304 would leave nothing to show.
+      sourceCache = ReleaseList();
+      etag.clear();
     }
+    feed.addSource(source, std::move(sourceCache), etag);
+  }
+  feed.publishCached();
+
+  ReleaseList list;
+  const std::vector<Release>& releases = list.releases;
+  feed.poll(list);
+  profile.mark("cache");
+
+  // Neither touches the network until started.
+  auto details = std::make_unique<ReleaseDetails>(sources);
+  PrefetchChoices prefetch;
+
+  screen.clear();
+  if (cached) {
+    const Release& r = releases[0];
+    displayRelease(screen, r,
+                   sources.size() > 1 ? sources[r.source].label
+                                      : std::string_view(),
+                   details->get(r), 0, releases.size(),
+                   "checking for updates...", "", prefetch.enabled());
+  } else {
+    screen.print(0, "Fetching releases...");
+    screen.present();
+  }
+  profile.mark("first_frame");
 
-    nifmExit();
-    socketExit();
-    consoleExit(nullptr);
+  if (!network.wait()) {
+    showMessage(screen, "Network init failed.\nPress [+] to exit.");
     return 1;
   }
+  profile.mark("network");
+  feed.start();
+
+  // Show the first page as soon as it has been parsed; the rest of the
+  // pages keep arriving in the background.
+  while (!cached && appletMainLoop()) {
+    bool finished = feed.isFinished();
+    feed.poll(list);
+    if (!releases.empty() || finished)
+      break;
+    FrameScheduler::get().wait();
+  }
 
-  std::cout << "Fetching releases...\n";
-  consoleUpdate(nullptr);
-
-  auto releases = fetchReleases(apiUrl, token);
   if (releases.empty()) {
-    consoleClear();
-    std::cout << "No releases found.\nPress [+] to exit.\n";
-    consoleUpdate(nullptr);
-
-    PadState pad;
-    padInitializeDefault(&pad);
-    while (appletMainLoop()) {
-      padUpdate(&pad);
-      if (padGetButtonsDown(&pad) & HidNpadButton_Plus)
-        break;
-      svcSleepThread(50'000'000ULL);
-    }
-
-    nifmExit();
-    socketExit();
-    consoleExit(nullptr);
+    showMessage(screen, "No releases found.\nPress [+] to exit.");
     return 0;
   }
 
-  int current = 0;
-  displayRelease(releases[current], current, releases.size());
+  // Downloads run on the network core; the browser below never waits on
+  // them.
+  auto downloads = std::make_unique<DownloadManager>();
+  // Keeps them running behind Home and with the screen dimmed, and
+  // restarts them from their journals when that is not possible. The
+  // manager's thread reports to it, so the manager is reset first below.
+  AppletMonitor applet([&]() { downloads->suspend(); },
+                       [&]() { downloads->resume(); },
+                       [&]() { downloads->restart(); });
+  downloads->setActivityListener(
+      [&applet](bool active) { applet.keepAwake(active); });
+  downloads->start();
+
+  details->start();
+
+  // Once a source's list is known to be current, the asset picked last
+  // time is fetched from its newest release ahead of time.
+  std::vector<bool> prefetchChecked(sources.size(), false);
+  auto sourceOf = [&](const Release& r) -> const Source& {
+    return sources[r.source];
+  };
+
+  auto feedStatus = [&]() -> std::string {
+    if (feed.isFinished())
+      return {};
+    return cached ? "checking for updates..." : "loading more...";
+  };
 
+  int current = 0;
+  std::string status = feedStatus();
+  std::string queueStatus = downloadSummary(*downloads);
+
+  // Looks up (or queues) the shown release's detail, warms its neighbours
+  // and redraws.
+  const ReleaseDetail* detail = nullptr;
+  unsigned detailGeneration = details->generation();
+  auto show = [&]() {
+    detailGeneration = details->generation();
+    detail = details->get(releases[current]);
+    details->prefetch(releases, current, kDetailPrefetchRadius);
+    const Release& r = releases[current];
+    displayRelease(screen, r,
+                   sources.size() > 1 ? sourceOf(r).label : std::string_view(),
+                   detail, current, releases.size(), status, queueStatus,
+                   prefetch.enabled());
+  };
+  show();
+  profile.mark("ready");
+  profile.report();
+
+  // Built when search is first opened for a list.
+  ReleaseIndex searchIndex;
+  bool searchIndexStale = true;
+  std::string searchQuery;
+
+  ReleaseList fresh;
+  std::vector<std::string_view> menuItems;
+  std::vector<size_t> nroAssets;
+
+  // "Download and launch": the queue entry being waited on, and what to
+  // say about it in place of the queue summary.
+  int launchId = 0;
+  std::string launchNote;
+  // A stored copy is re-hashed off the UI thread first; should it turn out
+  // damaged, `launchRequest` downloads it again.
+  std::unique_ptr<BlobCheck> launchCheck;
+  DownloadRequest launchRequest;
   PadState pad;
   padInitializeDefault(&pad);
 
@@ -515,36 +762,221 @@ int main() {
 
     if (btn & HidNpadButton_Plus)
       break;
+    if (btn)
+      FrameScheduler::get().markActive();
+
+    if ((btn & HidNpadButton_X) && detail && !detail->assets.empty()) {
+      const ArenaArray<Asset>& assets = detail->assets;
+      // The entries are views of the model's own strings; the vector keeps
+      // its capacity from one menu to the next.
+      menuItems.clear();
+      for (auto& a : assets)
+        menuItems.push_back(a.name);
+      int all = -1;
+      if (assets.size() > 1) {
+        all = menuItems.size();
+        menuItems.push_back("All assets");
+      }
+      menuItems.push_back("Back");
+
+      const Release& r = releases[current];
+      const Source& source = sourceOf(r);
+      int choice = runMenu(screen, menuItems, "Queue asset:");
+      if (all >= 0 && choice == all) {
+        for (auto& a : assets)
+          downloads->enqueue(assetRequest(source, r, *detail, a));
+      } else if (choice >= 0 && choice < (int)assets.size()) {
+        downloads->enqueue(assetRequest(source, r, *detail, assets[choice]));
+        prefetch.remember(source.apiUrl, assets[choice].name);
+      }
+      show();
+    }
 
-    if ((btn & HidNpadButton_X) && !releases[current].assets.empty()) {
-      std::vector<std::string> names;
-      for (auto& a : releases[current].assets)
-        names.push_back(a.name);
-      names.push_back("Back");
+    if ((btn & HidNpadButton_A) && detail && launchId == 0 && !launchCheck) {
+      nroAssets.clear();
+      for (size_t i = 0; i < detail->assets.size(); ++i) {
+        if (isLaunchable(detail->assets[i]))
+          nroAssets.push_back(i);
+      }
+      int choice = -1;
+      if (nroAssets.size() == 1)
+        choice = nroAssets[0];
+      if (nroAssets.size() > 1) {
+        menuItems.clear();
+        for (size_t i : nroAssets)
+          menuItems.push_back(detail->assets[i].name);
+        menuItems.push_back("Back");
+        int picked = runMenu(screen, menuItems, "Launch:");
+        if (picked >= 0 && picked < (int)nroAssets.size())
+          choice = nroAssets[picked];
+        show();
+      }
 
-      int choice = runMenu(names, "Select asset:");
-      if (choice >= 0 && choice < (int)names.size() - 1) {
-        downloadAsset(releases[current].assets[choice], token);
+      if (choice >= 0) {
+        const Asset& asset = detail->assets[choice];
+        const Release& r = releases[current];
+        const Source& source = sourceOf(r);
+        prefetch.remember(source.apiUrl, asset.name);
+        std::string stored =
+            ArtifactStore::get().find(source.storeTag(r.tag), asset.name);
+        launchNote.clear();
+        if (!canLaunchNro()) {
+          launchNote = "Launching needs the launcher to be started from hbmenu.";
+        } else {
+          DownloadRequest req = assetRequest(source, r, *detail, asset);
+          req.priority = DownloadPriority::High;
+          if (!stored.empty()) {
+            launchCheck = std::make_unique<BlobCheck>(stored);
+            launchRequest = std::move(req);
+            launchNote = "Checking " + std::string(asset.name) + "...";
+          } else {
+            launchNote = "Downloading " + std::string(asset.name) +
+                         " to launch it...";
+            launchId = downloads->enqueue(std::move(req));
+          }
+        }
       }
-      displayRelease(releases[current], current, releases.size());
     }
 
+    if (btn & HidNpadButton_Y) {
+      showDownloads(screen, *downloads);
+      show();
+    }
+
+    if (btn & HidNpadButton_R) {
+      if (searchIndexStale) {
+        screen.clear();
+        screen.print(0, "Indexing " + std::to_string(releases.size()) +
+                            " releases...");
+        screen.present();
+        searchIndex.build(releases, sources, isLaunchable);
+        searchIndexStale = false;
+      }
+      int picked = runSearch(screen, releases, searchIndex, searchQuery);
+      if (picked >= 0)
+        current = picked;
+      show();
+    }
+
+    if (btn & HidNpadButton_Minus) {
+      prefetch.setEnabled(!prefetch.enabled());
+      prefetchChecked.assign(sources.size(), false);
+      show();
+    }
+
+    if (launchId == 0 && (btn & (HidNpadButton_Down | HidNpadButton_Right |
+                                 HidNpadButton_Up | HidNpadButton_Left)))
+      launchNote.clear();
+
     if (btn & (HidNpadButton_Down | HidNpadButton_Right)) {
       current = (current + 1) % releases.size();
-      displayRelease(releases[current], current, releases.size());
+      show();
     }
 
     if (btn & (HidNpadButton_Up | HidNpadButton_Left)) {
       current = (current - 1 + releases.size()) % releases.size();
-      displayRelease(releases[current], current, releases.size());
+      show();
+    }
+
+    if (launchCheck && launchCheck->isDone()) {
+      bool matches = launchCheck->matches();
+      std::string stored = launchCheck->path();
+      launchCheck.reset();
+      if (matches) {
+        // The stored copy still hashes to its name; no need to fetch it
+        // again.
+        if (launchNro(stored))
+          break;
+        launchNote = "Could not launch " + launchRequest.asset + ".";
+      } else {
+        // verify() removed the damaged blob, so this is a real download.
+        launchNote = "Downloading " + launchRequest.asset + " to launch it...";
+        launchId = downloads->enqueue(std::move(launchRequest));
+      }
+    }
+
+    if (launchId != 0) {
+      DownloadInfo d;
+      if (!findDownload(*downloads, launchId, d) ||
+          d.status == DownloadStatus::Failed ||
+          d.status == DownloadStatus::Canceled) {
+        launchId = 0;
+        launchNote = d.verdict == DownloadVerdict::Mismatch
+                         ? "Checksum mismatch; not launching."
+                         : "Download did not finish; not launching.";
+      } else if (d.status == DownloadStatus::Done) {
+        launchId = 0;
+        if (launchNro(d.path))
+          break;
+        launchNote = "Could not launch " + d.name + ".";
+      }
+    }
+
+    std::string newStatus = feedStatus();
+    std::string newQueueStatus =
+        launchNote.empty() ? downloadSummary(*downloads) : launchNote;
+    std::string currentTag(releases[current].tag);
+    unsigned currentSource = releases[current].source;
+    bool changed = feed.poll(fresh) && !fresh.releases.empty();
+    if (changed) {
+      // Keep the selection on the same release when a refreshed list
+      // replaces the cached one.
+      std::swap(list, fresh);
+      // Free the previous generation's arena now rather than at the next
+      // poll.
+      fresh = ReleaseList();
+      details->clear();
+      searchIndexStale = true;
+      current = 0;
+      for (size_t i = 0; i < releases.size(); ++i) {
+        if (releases[i].tag == currentTag &&
+            releases[i].source == currentSource) {
+          current = i;
+          break;
+        }
+      }
+    }
+    // A failed refresh may leave a list stale; skip prefetching from it.
+    for (unsigned s = 0; s < sources.size() && prefetch.enabled() &&
+                         feed.isFinished();
+         ++s) {
+      if (prefetchChecked[s])
+        continue;
+      // The merged list is newest first.
+      auto newestOf = std::find_if(
+          releases.begin(), releases.end(),
+          [s](const Release& r) { return r.source == s; });
+      if (feed.hasFailed(s) || newestOf == releases.end()) {
+        prefetchChecked[s] = true;
+        continue;
+      }
+      const ReleaseDetail* newest = details->get(*newestOf);
+      if (!newest)
+        continue;
+      prefetchChecked[s] = true;
+      if (const Asset* a = prefetch.pick(sources[s].apiUrl, *newest)) {
+        DownloadRequest req = assetRequest(sources[s], *newestOf, *newest, *a);
+        req.priority = DownloadPriority::Low;
+        req.background = true;
+        downloads->enqueue(std::move(req));
+      }
+    }
+
+    bool detailArrived =
+        !detail && details->generation() != detailGeneration;
+    if (changed || detailArrived || newStatus != status ||
+        newQueueStatus != queueStatus) {
+      status = newStatus;
+      queueStatus = newQueueStatus;
+      show();
     }
 
-    consoleUpdate(nullptr);
-    svcSleepThread(50'000'000ULL);
+    FrameScheduler::get().wait();
   }
 
-  nifmExit();
-  socketExit();
-  consoleExit(nullptr);
+  // Stops running jobs, keeping resumable partial files, before the
+  // network goes away.
+  downloads.reset();
+  details.reset();
   return 0;
 }
@@ -0,0 +1,178 @@
+#include <cstdio>
+#include <iostream>
+
+#include "cache.h"
+#include "metrics.h"
+#include "platform.h"
+
+using Clock = std::chrono::steady_clock;
+
+static int elapsedMs(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(to - from)
+      .count();
+}
+
+// -------------------- Latency Histogram --------------------
+
+int LatencyHistogram::bucketLimitMs(int i) {
+  return i == kBuckets - 1 ? -1 : 1 << i;
+}
+
+void LatencyHistogram::record(Clock::duration d) {
+  long long ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+  int i = 0;
+  while (i < kBuckets - 1 && ms >= bucketLimitMs(i))
+    ++i;
+  counts[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Counts LatencyHistogram::snapshot() const {
+  Counts c;
+  for (int i = 0; i < kBuckets; ++i)
+    c.n[i] = counts[i].load(std::memory_order_relaxed);
+  return c;
+}
+
+uint32_t LatencyHistogram::Counts::total() const {
+  uint32_t sum = 0;
+  for (int i = 0; i < kBuckets; ++i)
+    sum += n[i];
+  return sum;
+}
+
+int LatencyHistogram::Counts::percentileMs(double p) const {
+  uint32_t all = total();
+  if (all == 0)
+    return -1;
+  uint32_t want = static_cast<uint32_t>(p * all);
+  if (want >= all)
+    want = all - 1;
+  uint32_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += n[i];
+    if (seen > want)
+      return bucketLimitMs(i < kBuckets - 1 ? i : i - 1);
+  }
+  return -1;
+}
+
+LatencyHistogram::Counts
+LatencyHistogram::Counts::since(const Counts& earlier) const {
+  Counts c;
+  for (int i = 0; i < kBuckets; ++i)
+    c.n[i] = n[i] - earlier.n[i];
+  return c;
+}
+
+bool LatencyHistogram::Counts::operator==(const Counts& o) const {
+  for (int i = 0; i < kBuckets; ++i) {
+    if (n[i] != o.n[i])
+      return false;
+  }
+  return true;
+}
+
+// -------------------- Transfer Statistics --------------------
+
+static int phaseMs(CURL* easy, CURLINFO info) {
+  curl_off_t us = 0;
+  if (curl_easy_getinfo(easy, info, &us) != CURLE_OK || us <= 0)
+    return -1;
+  return static_cast<int>(us / 1000);
+}
+
+void readPhaseTimes(CURL* easy, PhaseTimes& out) {
+  out.dnsMs = phaseMs(easy, CURLINFO_NAMELOOKUP_TIME_T);
+  out.connectMs = phaseMs(easy, CURLINFO_CONNECT_TIME_T);
+  out.tlsMs = phaseMs(easy, CURLINFO_APPCONNECT_TIME_T);
+  out.firstByteMs = phaseMs(easy, CURLINFO_STARTTRANSFER_TIME_T);
+}
+
+void RateMeter::start() {
+  begin = last = Clock::now();
+  lastBytes = -1;
+  movingBytes = -1;
+  stalled = false;
+}
+
+bool RateMeter::sample(curl_off_t bytes, bool blocked, TransferStats& stats) {
+  Clock::time_point now = Clock::now();
+  // Bytes resumed from an earlier run are there from the start and do not
+  // count towards the rate.
+  if (lastBytes < 0) {
+    lastBytes = bytes;
+    last = now;
+    return false;
+  }
+  int ms = elapsedMs(last, now);
+  if (ms < kIntervalMs)
+    return false;
+
+  curl_off_t got = bytes - lastBytes;
+  stats.rate = got > 0 ? got * 1000 / ms : 0;
+  if (got > 0 && movingBytes < 0) {
+    moving = last;
+    movingBytes = lastBytes;
+  }
+  if (movingBytes >= 0) {
+    int sinceMs = elapsedMs(moving, now);
+    if (sinceMs > 0)
+      stats.avgRate = (bytes - movingBytes) * 1000 / sinceMs;
+    // Waiting for the first byte is latency, not a stall.
+    bool idle = got <= 0 && !blocked;
+    if (idle && !stalled)
+      ++stats.stalls;
+    stalled = idle;
+  }
+  stats.elapsedMs = elapsedMs(begin, now);
+  last = now;
+  lastBytes = bytes;
+  return true;
+}
+
+// -------------------- Transfer Log --------------------
+
+TransferLog& TransferLog::get() {
+  static TransferLog log;
+  return log;
+}
+
+void TransferLog::record(const std::string& name, const char* status,
+                         curl_off_t bytes, const TransferStats& stats) {
+  std::string hist;
+  for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+    if (i > 0)
+      hist += ',';
+    hist += std::to_string(stats.diskWrites.n[i]);
+  }
+  std::string quoted;
+  for (char c : name)
+    quoted += c == '"' ? '\'' : c;
+
+  char line[512];
+  snprintf(line, sizeof(line),
+           "transfer name=\"%s\" status=%s bytes=%lld elapsed_ms=%d "
+           "dns_ms=%d connect_ms=%d tls_ms=%d ttfb_ms=%d avg_bps=%lld "
+           "stalls=%d disk_waits=%d disk_p50_ms=%d disk_p99_ms=%d "
+           "disk_hist=%s\n",
+           quoted.c_str(), status, (long long)bytes, stats.elapsedMs,
+           stats.phases.dnsMs, stats.phases.connectMs, stats.phases.tlsMs,
+           stats.phases.firstByteMs, (long long)stats.avgRate, stats.stalls,
+           stats.diskWaits, stats.diskWrites.percentileMs(0.5),
+           stats.diskWrites.percentileMs(0.99), hist.c_str());
+
+  std::lock_guard<std::mutex> lock(mtx);
+  if (stdoutForwarded()) {
+    fputs(line, stdout);
+    fflush(stdout);
+  }
+  std::string path = std::string(kAppDataDir) + "/transfers.log";
+  FILE* fp = fopen(path.c_str(), "a");
+  if (!fp) {
+    std::cerr << "Failed to open " << path << "\n";
+    return;
+  }
+  fputs(line, fp);
+  fclose(fp);
+}
@@ -0,0 +1,122 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// -------------------- Latency Histogram --------------------
+
+// Power-of-two buckets in milliseconds: [0,1), [1,2), [2,4), ... and a
+// last one for everything from ~1 s up. Lock-free, so the disk thread can
+// record while other threads read.
+class LatencyHistogram {
+public:
+  static const int kBuckets = 12;
+
+  struct Counts {
+    uint32_t n[kBuckets] = {};
+
+    uint32_t total() const;
+    // Upper bound in ms of the bucket holding the p-th fraction of samples
+    // (the last bucket gives its lower bound); -1 without samples.
+    int percentileMs(double p) const;
+    // Samples recorded since `earlier`.
+    Counts since(const Counts& earlier) const;
+    bool operator==(const Counts& o) const;
+  };
+
+  void record(std::chrono::steady_clock::duration d);
+  Counts snapshot() const;
+
+  // Upper bound of bucket `i` in ms (the last one has none: -1).
+  static int bucketLimitMs(int i);
+
+private:
+  std::atomic<uint32_t> counts[kBuckets] = {};
+};
+
+// -------------------- Transfer Statistics --------------------
+
+// Connection phases of a transfer, in ms from its start as libcurl counts
+// them (CURLINFO_*_TIME_T); -1 until reached.
+struct PhaseTimes {
+  int dnsMs = -1;
+  int connectMs = -1;
+  int tlsMs = -1;
+  int firstByteMs = -1;
+
+  bool operator==(const PhaseTimes& o) const {
+    return dnsMs == o.dnsMs && connectMs == o.connectMs && tlsMs == o.tlsMs &&
+           firstByteMs == o.firstByteMs;
+  }
+};
+
+// Fills in the phases `easy` has got through so far.
+void readPhaseTimes(CURL* easy, PhaseTimes& out);
+
+// What the download view and the transfer log show for one transfer.
+struct TransferStats {
+  PhaseTimes phases;
+  curl_off_t rate = 0;    // bytes/s over the last sampling interval
+  curl_off_t avgRate = 0; // bytes/s since the first byte
+  int elapsedMs = 0;
+  // Times bytes stopped arriving for a whole interval although the
+  // transfer could take them.
+  int stalls = 0;
+  // Times a connection was paused because every write buffer was waiting
+  // for the SD card.
+  int diskWaits = 0;
+  // Disk thread writes while this transfer ran (shared with any others).
+  LatencyHistogram::Counts diskWrites;
+
+  bool operator==(const TransferStats& o) const {
+    return phases == o.phases && rate == o.rate && avgRate == o.avgRate &&
+           elapsedMs == o.elapsedMs && stalls == o.stalls &&
+           diskWaits == o.diskWaits && diskWrites == o.diskWrites;
+  }
+  bool operator!=(const TransferStats& o) const { return !(*this == o); }
+};
+
+// Turns a running byte count into rates and stalls. Sampled from one
+// thread; each sample() closes an interval once kIntervalMs have passed.
+class RateMeter {
+public:
+  static const int kIntervalMs = 500;
+
+  void start();
+  // Returns true when a new interval was closed and `stats` updated.
+  // `blocked`: the transfer is waiting on the disk, not the network.
+  bool sample(curl_off_t bytes, bool blocked, TransferStats& stats);
+
+private:
+  std::chrono::steady_clock::time_point begin;
+  std::chrono::steady_clock::time_point last;
+  std::chrono::steady_clock::time_point moving; // first interval with data
+  curl_off_t lastBytes = -1; // -1: no sample yet
+  curl_off_t movingBytes = -1;
+  bool stalled = false;
+};
+
+// -------------------- Transfer Log --------------------
+
+// Appends one logfmt line per finished transfer to kAppDataDir/transfers.log
+// and, once nxlinkStdio() forwards it to a host, to stdout.
+class TransferLog {
+public:
+  static TransferLog& get();
+
+  void record(const std::string& name, const char* status, curl_off_t bytes,
+              const TransferStats& stats);
+
+private:
+  TransferLog() = default;
+
+  std::mutex mtx;
+};
+
+#endif // METRICS_H
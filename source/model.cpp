@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <cstring>
+
+#include "model.h"
+
+// -------------------- Arena --------------------
+
+void* Arena::allocateBytes(size_t size, size_t align) {
+  size_t pad = cursor ? (align - reinterpret_cast<uintptr_t>(cursor) % align) %
+                            align
+                      : 0;
+  if (!cursor || size + pad > left) {
+    // Blocks from new[] are aligned for any fundamental type.
+    size_t blockSize = size > kBlockSize ? size : kBlockSize;
+    blocks.emplace_back(new char[blockSize]);
+    cursor = blocks.back().get();
+    left = blockSize;
+    allocated += blockSize;
+    pad = 0;
+  }
+
+  char* out = cursor + pad;
+  cursor += pad + size;
+  left -= pad + size;
+  return out;
+}
+
+std::string_view Arena::add(std::string_view s) {
+  if (s.empty())
+    return {};
+  char* out = allocate<char>(s.size());
+  memcpy(out, s.data(), s.size());
+  return std::string_view(out, s.size());
+}
+
+void Arena::adopt(std::unique_ptr<char[]> block) {
+  // Keep the current block as the bump target; the adopted one is full.
+  blocks.insert(blocks.begin(), std::move(block));
+}
+
+void Arena::reset() {
+  blocks.clear();
+  cursor = nullptr;
+  left = 0;
+  allocated = 0;
+}
+
+// -------------------- Release List --------------------
+
+void ReleaseList::append(ReleaseList&& other) {
+  releases.reserve(releases.size() + other.releases.size());
+  for (auto& r : other.releases)
+    releases.push_back(std::move(r));
+  for (auto& a : other.arenas) {
+    // Pages of one generation share an arena; keep it listed once.
+    bool known = false;
+    for (auto& mine : arenas)
+      known = known || mine == a;
+    if (!known)
+      arenas.push_back(std::move(a));
+  }
+  other.releases.clear();
+  other.arenas.clear();
+}
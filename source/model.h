@@ -0,0 +1,111 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// -------------------- Model Types --------------------
+
+// Model types are trivially destructible views: their strings and arrays
+// live in an Arena owned by whoever produced them (the ReleaseList of a
+// fetch generation, or ReleaseDetails).
+
+// Fixed-size array allocated from an Arena.
+template <typename T>
+struct ArenaArray {
+  const T* items = nullptr;
+  size_t count = 0;
+
+  const T* begin() const { return items; }
+  const T* end() const { return items + count; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const T& operator[](size_t i) const { return items[i]; }
+};
+
+struct Asset {
+  std::string_view name;
+  std::string_view url;
+  // Another location of the same file (e.g. the link's own URL when `url`
+  // is its direct download); empty when there is none.
+  std::string_view mirror;
+};
+
+// What a release shows once it is opened. Loaded on demand through
+// ReleaseDetails rather than with the list.
+struct ReleaseDetail {
+  std::string_view description;
+  ArenaArray<Asset> assets;
+};
+
+// List entry: just enough to browse by.
+struct Release {
+  std::string_view tag;
+  std::string_view name;
+  std::string_view createdAt;
+  std::string_view commitId;
+  // The release's JSON object as the list endpoint returned it, turned into
+  // a ReleaseDetail only when needed. Empty when the detail has to be
+  // fetched from /releases/:tag instead.
+  std::string_view detailJson;
+  // Index of the source (see sources.h) that lists the release.
+  unsigned source = 0;
+};
+
+// -------------------- Arena --------------------
+
+// Bump allocator for model data. Nothing in it is freed on its own: all of
+// it goes at once when the arena is reset or destroyed, which is why only
+// trivially destructible types may be allocated from it.
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Copies `s` into the arena; the returned view lives as long as it does.
+  std::string_view add(std::string_view s);
+
+  // Uninitialised room for `n` objects of T.
+  template <typename T>
+  T* allocate(size_t n) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena objects are never destroyed");
+    return static_cast<T*>(allocateBytes(n * sizeof(T), alignof(T)));
+  }
+
+  // Takes ownership of a block whose contents are already laid out, such as
+  // a snapshot read from disk.
+  void adopt(std::unique_ptr<char[]> block);
+
+  // Drops everything allocated so far.
+  void reset();
+
+  size_t bytesAllocated() const { return allocated; }
+
+private:
+  static const size_t kBlockSize = 16 * 1024;
+
+  void* allocateBytes(size_t size, size_t align);
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char* cursor = nullptr;
+  size_t left = 0;
+  size_t allocated = 0;
+};
+
+struct ReleaseList {
+  std::vector<Release> releases;
+  // Usually a single arena for the whole fetch generation; dropping the
+  // list releases all of it at once.
+  std::vector<std::shared_ptr<const Arena>> arenas;
+
+  // Moves the releases of `other` to the end of this list and keeps its
+  // storage alive alongside ours.
+  void append(ReleaseList&& other);
+};
+
+#endif // MODEL_H
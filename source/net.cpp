@@ -0,0 +1,314 @@
+#include "net.h"
+
+#include <cctype>
+#include <cstring>
+#include <random>
+
+// -------------------- Protocol Support --------------------
+
+bool httpMultiplexSupported() {
+  static const bool supported =
+      (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2) != 0;
+  return supported;
+}
+
+// -------------------- Transfer Policy --------------------
+
+const TransferPolicy kTransferPolicy;
+
+void applyTransferPolicy(CURL* easy, const TransferPolicy& policy) {
+  curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, policy.connectTimeoutSec);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, policy.lowSpeedBytes);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, policy.lowSpeedSec);
+}
+
+bool isRetryableFailure(CURLcode res, long httpCode) {
+  switch (res) {
+  case CURLE_COULDNT_RESOLVE_HOST:
+  case CURLE_COULDNT_CONNECT:
+  case CURLE_OPERATION_TIMEDOUT:
+  case CURLE_SSL_CONNECT_ERROR:
+  case CURLE_SEND_ERROR:
+  case CURLE_RECV_ERROR:
+  case CURLE_GOT_NOTHING:
+  case CURLE_PARTIAL_FILE:
+  case CURLE_HTTP2:
+  case CURLE_HTTP2_STREAM:
+    return true;
+  case CURLE_HTTP_RETURNED_ERROR:
+    return httpCode == 408 || httpCode == 429 || httpCode >= 500;
+  default:
+    return false;
+  }
+}
+
+std::chrono::milliseconds retryDelay(int attempt,
+                                     const TransferPolicy& policy) {
+  // Seeded per thread; the jitter only has to differ between transfers.
+  thread_local std::minstd_rand random(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+  long long ceiling = policy.baseDelayMs;
+  for (int i = 1; i < attempt && ceiling < policy.maxDelayMs; ++i)
+    ceiling *= 2;
+  if (ceiling > policy.maxDelayMs)
+    ceiling = policy.maxDelayMs;
+  std::uniform_int_distribution<long long> pick(ceiling / 2, ceiling);
+  return std::chrono::milliseconds(pick(random));
+}
+
+// -------------------- Compression Policy --------------------
+
+// Shorter bodies are over before the rates mean anything.
+static const curl_off_t kMinMeasuredBytes = 64 * 1024;
+
+const std::string& supportedEncodings() {
+  static const std::string encodings = []() {
+    long features = curl_version_info(CURLVERSION_NOW)->features;
+    std::string list;
+    auto add = [&](const char* coding) {
+      if (!list.empty())
+        list += ", ";
+      list += coding;
+    };
+    if (features & CURL_VERSION_LIBZ) {
+      add("gzip");
+      add("deflate");
+    }
+    if (features & CURL_VERSION_BROTLI)
+      add("br");
+#ifdef CURL_VERSION_ZSTD
+    if (features & CURL_VERSION_ZSTD)
+      add("zstd");
+#endif
+    return list;
+  }();
+  return encodings;
+}
+
+CompressionPolicy& CompressionPolicy::get() {
+  static CompressionPolicy instance;
+  return instance;
+}
+
+void CompressionPolicy::record(CURL* easy, curl_off_t decoded,
+                               std::chrono::steady_clock::duration consumed) {
+  curl_off_t wire = 0, startUs = 0, totalUs = 0;
+  curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+  curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &startUs);
+  curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &totalUs);
+  curl_off_t parseUs =
+      std::chrono::duration_cast<std::chrono::microseconds>(consumed).count();
+  // The body's time includes the write callbacks; the rest went to the
+  // link (and to libcurl's decoding).
+  curl_off_t linkUs = totalUs - startUs - parseUs;
+  if (decoded < kMinMeasuredBytes || wire <= 0 || parseUs <= 0 || linkUs <= 0)
+    return;
+
+  // Bytes per microsecond. The link carries about as many raw bytes either
+  // way, so its rate tells how fast an identity body would arrive.
+  double linkRate = (double)wire / linkUs;
+  double parseRate = (double)decoded / parseUs;
+  std::lock_guard<std::mutex> lock(mtx);
+  double sample = linkRate / parseRate;
+  ratio = ratio < 0 ? sample : (ratio * 3 + sample) / 4;
+  bool want = on ? ratio <= 1 : ratio < 0.5;
+  if (want == on)
+    return;
+  on = want;
+  std::cerr << "Compression " << (want ? "on" : "off") << ": link "
+            << (long)(linkRate * 1000) << " KB/s, parser "
+            << (long)(parseRate * 1000) << " KB/s\n";
+}
+
+// -------------------- Redirects --------------------
+
+std::string urlHost(const std::string& url) {
+  size_t scheme_end = url.find("//");
+  size_t start = scheme_end == std::string::npos ? 0 : scheme_end + 2;
+  size_t end = url.find_first_of("/?#", start);
+  return url.substr(start, end == std::string::npos ? std::string::npos
+                                                     : end - start);
+}
+
+std::string redirectTarget(CURL* easy) {
+  long code = 0;
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &code);
+  char* location = nullptr;
+  if (code < 300 || code >= 400 ||
+      curl_easy_getinfo(easy, CURLINFO_REDIRECT_URL, &location) != CURLE_OK ||
+      !location)
+    return {};
+  return location;
+}
+
+// -------------------- Handle Pool --------------------
+
+// Idle handles kept for reuse; more than this are simply freed.
+static const size_t kMaxIdleHandles = 12;
+// Everything talks to one or two hosts, so resolved addresses can be kept
+// for longer than libcurl's 60 s default.
+static const long kDnsCacheSeconds = 300;
+
+CurlHandlePool& CurlHandlePool::get() {
+  static CurlHandlePool pool;
+  return pool;
+}
+
+CurlHandlePool::CurlHandlePool() {
+  share = curl_share_init();
+  if (!share) {
+    std::cerr << "CURL share init failed\n";
+    return;
+  }
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+  curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+void CurlHandlePool::lockShare(CURL*, curl_lock_data data, curl_lock_access,
+                               void* userptr) {
+  static_cast<CurlHandlePool*>(userptr)->shareLocks[data].lock();
+}
+
+void CurlHandlePool::unlockShare(CURL*, curl_lock_data data, void* userptr) {
+  static_cast<CurlHandlePool*>(userptr)->shareLocks[data].unlock();
+}
+
+void CurlHandlePool::applyDefaults(CURL* handle) {
+  if (share)
+    curl_easy_setopt(handle, CURLOPT_SHARE, share);
+  curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, kDnsCacheSeconds);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+  applyTransferPolicy(handle, kTransferPolicy);
+}
+
+CURL* CurlHandlePool::acquire() {
+  CURL* handle = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!idle.empty()) {
+      handle = idle.back();
+      idle.pop_back();
+    }
+  }
+  if (!handle)
+    handle = curl_easy_init();
+  if (!handle)
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(mtx);
+  if (!closed)
+    applyDefaults(handle);
+  return handle;
+}
+
+void CurlHandlePool::release(CURL* handle) {
+  // Drops every option of the previous request but keeps the handle's
+  // live connections and caches.
+  curl_easy_reset(handle);
+
+  std::lock_guard<std::mutex> lock(mtx);
+  if (closed || idle.size() >= kMaxIdleHandles) {
+    curl_easy_cleanup(handle);
+    // The last handle still attached lets a closed pool free the share.
+    if (closed && share && curl_share_cleanup(share) == CURLSHE_OK)
+      share = nullptr;
+    return;
+  }
+  idle.push_back(handle);
+}
+
+void CurlHandlePool::shutdown() {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (closed)
+    return;
+  closed = true;
+  for (CURL* handle : idle)
+    curl_easy_cleanup(handle);
+  idle.clear();
+  // Refused while handles still out of the pool are attached; release()
+  // tries again as they come back.
+  if (share && curl_share_cleanup(share) == CURLSHE_OK)
+    share = nullptr;
+}
+
+// -------------------- Response Headers for CURL --------------------
+
+static bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i]))
+      return false;
+  }
+  return true;
+}
+
+static std::string trim(const std::string& s) {
+  size_t b = s.find_first_not_of(" \t\r\n");
+  if (b == std::string::npos)
+    return {};
+  size_t e = s.find_last_not_of(" \t\r\n");
+  return s.substr(b, e - b + 1);
+}
+
+size_t HeaderBuffer::HeaderCallback(char* ptr, size_t size, size_t nitems,
+                                    void* userdata) {
+  auto* self = static_cast<HeaderBuffer*>(userdata);
+  std::string line(ptr, size * nitems);
+
+  // A new status line starts a new response (e.g. after a redirect).
+  if (line.rfind("HTTP/", 0) == 0) {
+    self->headers.clear();
+    return size * nitems;
+  }
+
+  size_t colon = line.find(':');
+  if (colon != std::string::npos) {
+    self->headers.emplace_back(trim(line.substr(0, colon)),
+                               trim(line.substr(colon + 1)));
+  }
+  return size * nitems;
+}
+
+std::string HeaderBuffer::get(const std::string& name) const {
+  for (auto& h : headers) {
+    if (equalsIgnoreCase(h.first, name))
+      return h.second;
+  }
+  return {};
+}
+
+// -------------------- Request Helpers --------------------
+
+struct curl_slist* makeApiHeaders(const std::string& token) {
+  struct curl_slist* headers = nullptr;
+  if (!token.empty()) {
+    headers = curl_slist_append(headers, ("PRIVATE-TOKEN: " + token).c_str());
+  }
+  headers = curl_slist_append(headers, "Accept: application/json");
+  return headers;
+}
+
+std::string linkNextUrl(const std::string& linkHeader) {
+  size_t pos = 0;
+  while (pos < linkHeader.size()) {
+    size_t open = linkHeader.find('<', pos);
+    if (open == std::string::npos)
+      break;
+    size_t close = linkHeader.find('>', open);
+    if (close == std::string::npos)
+      break;
+    size_t end = linkHeader.find(',', close);
+    std::string params = linkHeader.substr(
+        close + 1, end == std::string::npos ? std::string::npos : end - close - 1);
+    if (params.find("rel=\"next\"") != std::string::npos)
+      return linkHeader.substr(open + 1, close - open - 1);
+    if (end == std::string::npos)
+      break;
+    pos = end + 1;
+  }
+  return {};
+}
@@ -0,0 +1,307 @@
+#ifndef NET_H
+#define NET_H
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+
+// -------------------- Transfer Policy --------------------
+
+// How long a transfer may take to connect or may crawl before libcurl
+// gives it up, and how often and how far apart failed transfers are tried
+// again. Every pooled handle gets the timeouts.
+struct TransferPolicy {
+  long connectTimeoutSec = 15;
+  // Fewer than lowSpeedBytes per second for lowSpeedSec seconds in a row
+  // fails the transfer with CURLE_OPERATION_TIMEDOUT.
+  long lowSpeedBytes = 512;
+  long lowSpeedSec = 20;
+  // Including the first one.
+  int maxAttempts = 5;
+  int baseDelayMs = 500;
+  int maxDelayMs = 30000;
+};
+
+extern const TransferPolicy kTransferPolicy;
+
+void applyTransferPolicy(CURL* easy, const TransferPolicy& policy);
+
+// True for failures a later attempt may get past: timeouts, refused or
+// dropped connections, and 408, 429 and 5xx answers. Cancellation, write
+// errors and other HTTP errors are final.
+bool isRetryableFailure(CURLcode res, long httpCode);
+
+// Wait before retry number `attempt` (1 for the first): doubling up to
+// maxDelayMs, picked at random from the upper half so transfers that
+// failed together do not retry together.
+std::chrono::milliseconds retryDelay(int attempt,
+                                     const TransferPolicy& policy);
+
+// -------------------- Compression Policy --------------------
+
+// Accept-Encoding list of the content codings the linked libcurl decodes
+// (at most "gzip, deflate, br, zstd"); empty when it decodes none.
+const std::string& supportedEncodings();
+
+// Whether metadata requests (release pages, details, checksum lists) ask
+// for a compressed body. libcurl decodes each chunk before the write
+// callback sees it, so a compressed page still streams into the parser and
+// is never inflated whole. Compressed JSON is several times smaller, which
+// pays while the link is the bottleneck; on a fast LAN the parser is, and
+// inflating in front of it only adds work. Measured transfers keep a moving
+// average of the link's rate over the parser's: compression goes off once
+// the link delivers faster than the parser consumes, and back on once it
+// falls under half of that.
+class CompressionPolicy {
+public:
+  static CompressionPolicy& get();
+
+  bool enabled() const { return on; }
+
+  // After a streamed transfer on `easy`: `decoded` body bytes reached the
+  // parser, which spent `consumed` handling them.
+  void record(CURL* easy, curl_off_t decoded,
+              std::chrono::steady_clock::duration consumed);
+
+private:
+  CompressionPolicy() = default;
+
+  std::atomic<bool> on{true};
+  std::mutex mtx;
+  double ratio = -1; // link rate / parser rate; -1 before the first sample
+};
+
+// -------------------- Redirects --------------------
+
+// libcurl drops Authorization and Cookie when CURLOPT_FOLLOWLOCATION takes
+// it to another host, but keeps custom headers such as PRIVATE-TOKEN, which
+// would then reach the object storage an artifact redirects to. Requests
+// that carry the token follow redirects themselves instead, sending it
+// only while on the host of the URL they started from.
+static const int kMaxRedirects = 10;
+
+// The host[:port] part of `url`.
+std::string urlHost(const std::string& url);
+
+// Where the finished 3xx response on `easy` points, resolved against its
+// URL; empty for any other response.
+std::string redirectTarget(CURL* easy);
+
+// -------------------- CURL RAII Helpers --------------------
+
+// Easy handles are recycled instead of being created per request. Every
+// handle handed out is attached to one process-wide CURLSH holding the DNS
+// and TLS session caches, so a new connection to a host we already talked
+// to skips the lookup and resumes the TLS session instead of doing a full
+// handshake. Connections themselves stay in the curl_multi (or, with
+// curl_easy_perform, the easy handle) that opened them; libcurl does not
+// support sharing a connection cache between concurrent threads.
+class CurlHandlePool {
+public:
+  static CurlHandlePool& get();
+
+  // Returns a handle with default options plus the shared caches, or
+  // nullptr when libcurl is out of memory.
+  CURL* acquire();
+  void release(CURL* handle);
+
+  // Frees idle handles and the share; later releases just clean up, and
+  // the share goes with the last of them when some were still out.
+  // Called before curl_global_cleanup().
+  void shutdown();
+
+private:
+  CurlHandlePool();
+
+  static void lockShare(CURL*, curl_lock_data data, curl_lock_access,
+                        void* userptr);
+  static void unlockShare(CURL*, curl_lock_data data, void* userptr);
+  void applyDefaults(CURL* handle);
+
+  std::mutex mtx;
+  std::vector<CURL*> idle;
+  CURLSH* share = nullptr;
+  bool closed = false;
+  std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+};
+
+// True when the linked libcurl was built with HTTP/2 support.
+bool httpMultiplexSupported();
+
+class CurlGlobal {
+public:
+  CurlGlobal() { curl_global_init(CURL_GLOBAL_ALL); }
+  ~CurlGlobal() {
+    CurlHandlePool::get().shutdown();
+    curl_global_cleanup();
+  }
+};
+
+class CurlEasy {
+public:
+  CurlEasy() : handle(CurlHandlePool::get().acquire()) {
+    if (!handle) {
+      std::cerr << "CURL init failed\n";
+      std::exit(1);
+    }
+  }
+
+  ~CurlEasy() {
+    if (handle)
+      CurlHandlePool::get().release(handle);
+  }
+
+  CurlEasy(const CurlEasy&) = delete;
+  CurlEasy& operator=(const CurlEasy&) = delete;
+
+  void setopt(CURLoption opt, const char* v) {
+    curl_easy_setopt(handle, opt, v);
+  }
+
+  void setopt(CURLoption opt, struct curl_slist* v) {
+    curl_easy_setopt(handle, opt, v);
+  }
+
+  void setopt(CURLoption opt, long v) {
+    curl_easy_setopt(handle, opt, v);
+  }
+
+  // Runs the transfer to its end; a failure is logged and returned.
+  CURLcode perform() {
+    CURLcode res = curl_easy_perform(handle);
+    if (res != CURLE_OK)
+      std::cerr << "CURL error: " << curl_easy_strerror(res) << "\n";
+    return res;
+  }
+
+  // Negotiates HTTP/2 over TLS (ALPN) when libcurl supports it; servers
+  // that only speak HTTP/1.1 are used as before. With PIPEWAIT, requests
+  // started together wait for the first connection to learn whether it
+  // multiplexes instead of each opening their own.
+  void preferHttp2() {
+    if (!httpMultiplexSupported())
+      return;
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+  }
+
+  // Asks for a compressed body while CompressionPolicy allows it.
+  void acceptCompressed() {
+    const std::string& encodings = supportedEncodings();
+    if (!encodings.empty() && CompressionPolicy::get().enabled())
+      curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, encodings.c_str());
+  }
+
+  // For transfers that want a TCP connection of their own, e.g. parallel
+  // range segments that would otherwise share one h2 flow-control window.
+  void requireHttp1() {
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+  }
+
+  long getResponseCode() const {
+    long code = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
+    return code;
+  }
+
+  CURL* getHandle() const { return handle; }
+
+private:
+  CURL* handle = nullptr;
+};
+
+class CurlMulti {
+public:
+  CurlMulti() : handle(curl_multi_init()) {
+    if (!handle) {
+      std::cerr << "CURL multi init failed\n";
+      std::exit(1);
+    }
+    // Let HTTP/2 transfers to the same host share one connection.
+    curl_multi_setopt(handle, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+  }
+
+  ~CurlMulti() {
+    if (handle)
+      curl_multi_cleanup(handle);
+  }
+
+  CurlMulti(const CurlMulti&) = delete;
+  CurlMulti& operator=(const CurlMulti&) = delete;
+
+  void add(CurlEasy& easy) { curl_multi_add_handle(handle, easy.getHandle()); }
+  void remove(CurlEasy& easy) {
+    curl_multi_remove_handle(handle, easy.getHandle());
+  }
+
+  // Drives all attached transfers, waiting up to timeoutMs for socket
+  // activity. Returns the number of transfers still running.
+  int perform(int timeoutMs) {
+    int running = 0;
+    curl_multi_perform(handle, &running);
+    if (running > 0) {
+      curl_multi_poll(handle, nullptr, 0, timeoutMs, nullptr);
+      curl_multi_perform(handle, &running);
+    }
+    return running;
+  }
+
+  // Returns the next finished transfer, or nullptr when there is none.
+  CURLMsg* nextDone() {
+    int queued = 0;
+    CURLMsg* msg;
+    while ((msg = curl_multi_info_read(handle, &queued))) {
+      if (msg->msg == CURLMSG_DONE)
+        return msg;
+    }
+    return nullptr;
+  }
+
+  CURLM* getHandle() const { return handle; }
+
+private:
+  CURLM* handle = nullptr;
+};
+
+// -------------------- Memory Buffer for CURL --------------------
+
+class MemoryBuffer {
+public:
+  static size_t WriteCallback(void* ptr, size_t size, size_t nmemb, void* userdata) {
+    auto* self = static_cast<MemoryBuffer*>(userdata);
+    self->data.append(static_cast<char*>(ptr), size * nmemb);
+    return size * nmemb;
+  }
+
+  std::string data;
+};
+
+// -------------------- Response Headers for CURL --------------------
+
+class HeaderBuffer {
+public:
+  static size_t HeaderCallback(char* ptr, size_t size, size_t nitems, void* userdata);
+
+  // Case-insensitive lookup; returns an empty string when absent.
+  std::string get(const std::string& name) const;
+
+  // Only the headers of the last response are kept, so redirects followed
+  // with CURLOPT_FOLLOWLOCATION do not leak into the final result.
+  std::vector<std::pair<std::string, std::string>> headers;
+};
+
+// GitLab API request headers: PRIVATE-TOKEN (when set) and Accept JSON.
+// The caller owns the returned list.
+struct curl_slist* makeApiHeaders(const std::string& token);
+
+// Extracts the rel="next" target from an RFC 8288 Link header.
+std::string linkNextUrl(const std::string& linkHeader);
+
+#endif // NET_H
@@ -0,0 +1,32 @@
+#ifdef __SWITCH__
+#include <switch.h>
+#endif
+
+#include <atomic>
+#include <iostream>
+
+#include "platform.h"
+
+// -------------------- Thread Placement --------------------
+
+void pinCurrentThreadToCore(int core) {
+#ifdef __SWITCH__
+  Result rc = svcSetThreadCoreMask(CUR_THREAD_HANDLE, core, 1u << core);
+  if (R_FAILED(rc))
+    std::cerr << "Failed to pin thread to core " << core << ": " << rc << "\n";
+#else
+  (void)core;
+#endif
+}
+
+// -------------------- Log Output --------------------
+
+#ifdef __SWITCH__
+static std::atomic<bool> forwarded{false};
+#else
+static std::atomic<bool> forwarded{true};
+#endif
+
+bool stdoutForwarded() { return forwarded; }
+
+void markStdoutForwarded() { forwarded = true; }
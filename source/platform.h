@@ -0,0 +1,23 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// -------------------- Thread Placement --------------------
+
+// Applications get three usable cores. The UI and input loop stay on the
+// main thread's core; network and disk work each get one of the others.
+static const int kUiCore = 0;
+static const int kNetworkCore = 1;
+static const int kDiskCore = 2;
+
+// Restricts the calling thread to `core`. No-op off the Switch.
+void pinCurrentThreadToCore(int core);
+
+// -------------------- Log Output --------------------
+
+// On the Switch stdout is the console the Screen draws on until
+// nxlinkStdio() hands it to a host; log lines are only written there once
+// that has happened, and always off the Switch.
+bool stdoutForwarded();
+void markStdoutForwarded();
+
+#endif // PLATFORM_H
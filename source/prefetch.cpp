@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <iostream>
+#include <strings.h>
+
+#include "cache.h"
+#include "prefetch.h"
+
+// -------------------- Asset Prefetch --------------------
+
+// Lines are "enabled\t0|1" and "choice\t<project>\t<asset>".
+static std::string choicesPath() {
+  return std::string(kAppDataDir) + "/prefetch.txt";
+}
+
+PrefetchChoices::PrefetchChoices() { load(); }
+
+void PrefetchChoices::load() {
+  FILE* fp = fopen(choicesPath().c_str(), "r");
+  if (!fp)
+    return;
+  char buf[1024];
+  while (fgets(buf, sizeof(buf), fp)) {
+    std::string_view line(buf);
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+      line.remove_suffix(1);
+    size_t tab = line.find('\t');
+    if (tab == std::string_view::npos)
+      continue;
+    std::string_view kind = line.substr(0, tab);
+    std::string_view rest = line.substr(tab + 1);
+    if (kind == "enabled") {
+      on = rest == "1";
+    } else if (kind == "choice") {
+      size_t sep = rest.rfind('\t');
+      if (sep != std::string_view::npos)
+        choices[std::string(rest.substr(0, sep))] =
+            std::string(rest.substr(sep + 1));
+    }
+  }
+  fclose(fp);
+}
+
+void PrefetchChoices::save() const {
+  ensureAppDataDirectory();
+  std::string path = choicesPath();
+  std::string tmp = path + ".tmp";
+  FILE* fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    std::cerr << "Failed to open " << tmp << "\n";
+    return;
+  }
+  fprintf(fp, "enabled\t%d\n", on ? 1 : 0);
+  for (auto& c : choices)
+    fprintf(fp, "choice\t%s\t%s\n", c.first.c_str(), c.second.c_str());
+  bool ok = fclose(fp) == 0;
+  remove(path.c_str());
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    std::cerr << "Failed to write " << path << "\n";
+}
+
+void PrefetchChoices::setEnabled(bool enabled) {
+  if (on == enabled)
+    return;
+  on = enabled;
+  save();
+}
+
+void PrefetchChoices::remember(const std::string& project,
+                               std::string_view asset) {
+  std::string& entry = choices[project];
+  if (entry == asset)
+    return;
+  entry = std::string(asset);
+  save();
+}
+
+const Asset* PrefetchChoices::pick(const std::string& project,
+                                   const ReleaseDetail& detail) const {
+  auto it = choices.find(project);
+  if (it == choices.end())
+    return nullptr;
+  for (auto& a : detail.assets) {
+    if (a.name.size() == it->second.size() &&
+        strncasecmp(a.name.data(), it->second.data(), a.name.size()) == 0)
+      return &a;
+  }
+  return nullptr;
+}
@@ -0,0 +1,39 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "model.h"
+
+// -------------------- Asset Prefetch --------------------
+
+// Remembers, per project, the asset last picked by hand, so the same asset
+// of the next release can be downloaded before anyone asks for it. Off
+// until switched on. Kept in kAppDataDir/prefetch.txt.
+class PrefetchChoices {
+public:
+  PrefetchChoices();
+
+  bool enabled() const { return on; }
+  void setEnabled(bool enabled);
+
+  // `project` identifies the release source, e.g. its API URL.
+  void remember(const std::string& project, std::string_view asset);
+
+  // The asset of `detail` named like the one remembered for `project`
+  // (ignoring case), or nullptr.
+  const Asset* pick(const std::string& project,
+                    const ReleaseDetail& detail) const;
+
+private:
+  void load();
+  void save() const;
+
+  bool on = false;
+  // project -> asset name, for every project seen.
+  std::unordered_map<std::string, std::string> choices;
+};
+
+#endif // PREFETCH_H
@@ -0,0 +1,979 @@
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "cache.h"
+#include "net.h"
+#include "releases.h"
+
+// Largest page size the GitLab API accepts.
+static const int kReleasesPerPage = 100;
+// Pages fetched at once; more than this only queues behind the same host.
+static const long kMaxParallelPages = 4;
+
+// -------------------- JSON Helpers --------------------
+
+static std::string_view jsonGetString(json_t* obj, const char* key) {
+  if (!obj)
+    return {};
+  json_t* val = json_object_get(obj, key);
+  if (!json_is_string(val))
+    return {};
+  return std::string_view(json_string_value(val), json_string_length(val));
+}
+
+// -------------------- Parse Releases from JSON --------------------
+
+// Finds the elements of a top-level JSON array without building anything:
+// only strings and nesting are tracked. Returns false on malformed input.
+static bool splitJsonArray(std::string_view text,
+                           std::vector<std::string_view>& out) {
+  auto isSpace = [](char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  };
+  size_t i = 0;
+  while (i < text.size() && isSpace(text[i]))
+    ++i;
+  if (i == text.size() || text[i] != '[')
+    return false;
+  ++i;
+
+  int depth = 0;
+  bool inString = false;
+  size_t begin = std::string_view::npos;
+  for (; i < text.size(); ++i) {
+    char c = text[i];
+    if (inString) {
+      if (c == '\\')
+        ++i;
+      else if (c == '"')
+        inString = false;
+      continue;
+    }
+    if (begin == std::string_view::npos && !isSpace(c) && c != ',' &&
+        !(depth == 0 && c == ']'))
+      begin = i;
+    switch (c) {
+    case '"':
+      inString = true;
+      break;
+    case '{':
+    case '[':
+      ++depth;
+      break;
+    case '}':
+    case ']':
+      if (depth == 0) {
+        if (begin != std::string_view::npos)
+          return false;
+        return true;
+      }
+      if (--depth == 0 && begin != std::string_view::npos) {
+        out.push_back(text.substr(begin, i + 1 - begin));
+        begin = std::string_view::npos;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return false;
+}
+
+ReleaseList parseReleases(const std::string& rawJson,
+                          std::shared_ptr<Arena> arena) {
+  ReleaseList result;
+  if (!arena)
+    arena = std::make_shared<Arena>();
+  Arena* store = arena.get();
+  result.arenas.push_back(arena);
+  json_error_t err;
+  json_t* root = json_loads(rawJson.c_str(), 0, &err);
+  if (!root) {
+    std::cerr << "JSON parse error: " << err.text << "\n";
+    return result;
+  }
+
+  if (!json_is_array(root)) {
+    std::cerr << "Expected JSON array\n";
+    json_decref(root);
+    return result;
+  }
+
+  // Keep the page text so each release's object can be parsed for its
+  // details later; only the list fields are extracted now.
+  std::unique_ptr<char[]> body(new char[rawJson.size()]);
+  memcpy(body.get(), rawJson.data(), rawJson.size());
+  std::string_view text(body.get(), rawJson.size());
+  store->adopt(std::move(body));
+  std::vector<std::string_view> objects;
+  if (!splitJsonArray(text, objects) || objects.size() != json_array_size(root))
+    objects.clear();
+
+  size_t idx;
+  json_t* item;
+  json_array_foreach(root, idx, item) {
+    Release r;
+    r.tag       = store->add(jsonGetString(item, "tag_name"));
+    r.name      = store->add(jsonGetString(item, "name"));
+    r.createdAt = store->add(jsonGetString(item, "created_at"));
+
+    json_t* commitObj = json_object_get(item, "commit");
+    if (json_is_object(commitObj)) {
+      r.commitId = store->add(jsonGetString(commitObj, "short_id"));
+    } else {
+      // GitHub names the branch or commit the tag was made from instead.
+      r.commitId = store->add(jsonGetString(item, "target_commitish"));
+    }
+    if (idx < objects.size())
+      r.detailJson = objects[idx];
+
+    result.releases.push_back(std::move(r));
+  }
+
+  json_decref(root);
+  return result;
+}
+
+bool parseReleaseDetail(std::string_view json, Arena& arena,
+                        ReleaseDetail& out) {
+  json_error_t err;
+  json_t* item = json_loadb(json.data(), json.size(), 0, &err);
+  if (!json_is_object(item)) {
+    std::cerr << "JSON parse error in release: " << err.text << "\n";
+    json_decref(item);
+    return false;
+  }
+
+  out.description = arena.add(jsonGetString(item, "description"));
+  out.assets = {};
+
+  json_t* assetsObj = json_object_get(item, "assets");
+  json_t* links = json_object_get(assetsObj, "links");
+  json_t* sources = json_object_get(assetsObj, "sources");
+  // Sized for every entry up front; the few skipped ones waste a slot.
+  size_t capacity = json_array_size(links) + json_array_size(sources);
+  Asset* assets = capacity ? arena.allocate<Asset>(capacity) : nullptr;
+  size_t count = 0;
+
+  if (json_is_object(assetsObj)) {
+    if (json_is_array(links)) {
+      size_t ai;
+      json_t* linkItem;
+      json_array_foreach(links, ai, linkItem) {
+        std::string_view name = jsonGetString(linkItem, "name");
+        std::string_view url = jsonGetString(linkItem, "direct_asset_url");
+        std::string_view link = jsonGetString(linkItem, "url");
+        if (url.empty())
+          url = link;
+        if (name.empty() || url.empty())
+          continue;
+        assets[count++] = {arena.add(name), arena.add(url),
+                           link != url ? arena.add(link) : std::string_view()};
+      }
+    }
+
+    if (json_is_array(sources)) {
+      size_t si;
+      json_t* srcItem;
+      json_array_foreach(sources, si, srcItem) {
+        std::string name = "Source (";
+        name += jsonGetString(srcItem, "format");
+        name += ")";
+        std::string_view url = jsonGetString(srcItem, "url");
+        if (!url.empty())
+          assets[count++] = {arena.add(name), arena.add(url)};
+      }
+    }
+  }
+  out.assets = {assets, count};
+
+  json_decref(item);
+  return true;
+}
+
+bool parseGitHubReleaseDetail(std::string_view json, Arena& arena,
+                              ReleaseDetail& out) {
+  json_error_t err;
+  json_t* item = json_loadb(json.data(), json.size(), 0, &err);
+  if (!json_is_object(item)) {
+    std::cerr << "JSON parse error in release: " << err.text << "\n";
+    json_decref(item);
+    return false;
+  }
+
+  out.description = arena.add(jsonGetString(item, "body"));
+
+  // Uploaded assets, then the two source archives GitHub offers for
+  // every tag.
+  json_t* uploaded = json_object_get(item, "assets");
+  size_t capacity = json_array_size(uploaded) + 2;
+  Asset* assets = arena.allocate<Asset>(capacity);
+  size_t count = 0;
+
+  if (json_is_array(uploaded)) {
+    size_t ai;
+    json_t* assetItem;
+    json_array_foreach(uploaded, ai, assetItem) {
+      std::string_view name = jsonGetString(assetItem, "name");
+      std::string_view url = jsonGetString(assetItem, "browser_download_url");
+      if (!name.empty() && !url.empty())
+        assets[count++] = {arena.add(name), arena.add(url)};
+    }
+  }
+  std::string_view zip = jsonGetString(item, "zipball_url");
+  if (!zip.empty())
+    assets[count++] = {arena.add("Source (zip)"), arena.add(zip)};
+  std::string_view tar = jsonGetString(item, "tarball_url");
+  if (!tar.empty())
+    assets[count++] = {arena.add("Source (tar.gz)"), arena.add(tar)};
+  out.assets = {assets, count};
+
+  json_decref(item);
+  return true;
+}
+
+// -------------------- Streaming Release Parser --------------------
+
+static bool isJsonSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Characters of numbers, true, false and null. They are not validated
+// further; nothing the list needs is a literal.
+static bool isLiteralChar(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' ||
+         c == '+' || c == '.' || c == 'E';
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static void putUtf8(std::string& out, unsigned cp) {
+  if (cp < 0x80) {
+    out += char(cp);
+  } else if (cp < 0x800) {
+    out += char(0xC0 | (cp >> 6));
+    out += char(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out += char(0xE0 | (cp >> 12));
+    out += char(0x80 | ((cp >> 6) & 0x3F));
+    out += char(0x80 | (cp & 0x3F));
+  } else {
+    out += char(0xF0 | (cp >> 18));
+    out += char(0x80 | ((cp >> 12) & 0x3F));
+    out += char(0x80 | ((cp >> 6) & 0x3F));
+    out += char(0x80 | (cp & 0x3F));
+  }
+}
+
+ReleaseStreamParser::ReleaseStreamParser(std::shared_ptr<Arena> arena)
+    : store(arena ? std::move(arena) : std::make_shared<Arena>()) {}
+
+size_t ReleaseStreamParser::WriteCallback(void* ptr, size_t size, size_t nmemb,
+                                          void* userdata) {
+  auto* self = static_cast<ReleaseStreamParser*>(userdata);
+  self->feed(static_cast<const char*>(ptr), size * nmemb);
+  return size * nmemb;
+}
+
+void ReleaseStreamParser::feed(const char* data, size_t n) {
+  if (failed)
+    return;
+  // A release object that started in an earlier chunk continues here.
+  if (objectFrom != std::string::npos)
+    objectFrom = 0;
+
+  for (size_t i = 0; i < n && !failed; ++i) {
+    char c = data[i];
+    switch (mode) {
+    case Mode::String:
+      if (c == '"') {
+        mode = Mode::Normal;
+        stringDone();
+      } else if (c == '\\') {
+        mode = Mode::Escape;
+      } else if ((unsigned char)c < 0x20) {
+        fail();
+      } else if (keepString) {
+        flushSurrogate();
+        scratch += c;
+      }
+      continue;
+
+    case Mode::Escape: {
+      mode = Mode::String;
+      char out = 0;
+      switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        out = c;
+        break;
+      case 'b':
+        out = '\b';
+        break;
+      case 'f':
+        out = '\f';
+        break;
+      case 'n':
+        out = '\n';
+        break;
+      case 'r':
+        out = '\r';
+        break;
+      case 't':
+        out = '\t';
+        break;
+      case 'u':
+        mode = Mode::Unicode;
+        unicode = 0;
+        unicodeDigits = 0;
+        break;
+      default:
+        fail();
+        break;
+      }
+      if (out && keepString) {
+        flushSurrogate();
+        scratch += out;
+      }
+      continue;
+    }
+
+    case Mode::Unicode: {
+      int v = hexValue(c);
+      if (v < 0) {
+        fail();
+        continue;
+      }
+      unicode = unicode * 16 + v;
+      if (++unicodeDigits == 4) {
+        mode = Mode::String;
+        if (keepString)
+          appendCodepoint(unicode);
+      }
+      continue;
+    }
+
+    case Mode::Literal:
+      if (isLiteralChar(c))
+        continue;
+      // The delimiter that ended the literal is handled below.
+      mode = Mode::Normal;
+      valueDone();
+      break;
+
+    case Mode::Normal:
+      break;
+    }
+
+    if (isJsonSpace(c))
+      continue;
+
+    switch (expect) {
+    case Expect::Value:
+      if (c == '{' || c == '[') {
+        open(c, i);
+      } else if (c == ']' && justOpened) {
+        close(c, data, i);
+      } else if (stack.empty()) {
+        fail(); // the body must be an array
+      } else if (c == '"') {
+        mode = Mode::String;
+        stringIsKey = false;
+        keepString = wantString();
+        scratch.clear();
+      } else if (isLiteralChar(c)) {
+        mode = Mode::Literal;
+      } else {
+        fail();
+      }
+      break;
+    case Expect::Key:
+      if (c == '"') {
+        mode = Mode::String;
+        stringIsKey = true;
+        keepString = true;
+        scratch.clear();
+      } else if (c == '}' && justOpened) {
+        close(c, data, i);
+      } else {
+        fail();
+      }
+      break;
+    case Expect::Colon:
+      if (c == ':')
+        expect = Expect::Value;
+      else
+        fail();
+      break;
+    case Expect::CommaOrClose:
+      if (c == ',') {
+        expect = stack.back() == '{' ? Expect::Key : Expect::Value;
+      } else if ((c == '}' && stack.back() == '{') ||
+                 (c == ']' && stack.back() == '[')) {
+        close(c, data, i);
+      } else {
+        fail();
+      }
+      break;
+    case Expect::End:
+      fail();
+      break;
+    }
+  }
+
+  if (!failed && objectFrom != std::string::npos)
+    object.append(data + objectFrom, n - objectFrom);
+}
+
+void ReleaseStreamParser::open(char c, size_t pos) {
+  if (stack.empty() && c != '[') {
+    fail();
+    return;
+  }
+  stack.push_back(c);
+  size_t depth = stack.size();
+  if (depth < kKeyLevels)
+    keys[depth].clear();
+  if (depth == 2 && c == '{') {
+    current = Release();
+    object.clear();
+    objectFrom = pos;
+  }
+  expect = c == '{' ? Expect::Key : Expect::Value;
+  justOpened = true;
+}
+
+void ReleaseStreamParser::close(char c, const char* data, size_t pos) {
+  if (stack.size() == 2 && c == '}' && objectFrom != std::string::npos) {
+    object.append(data + objectFrom, pos + 1 - objectFrom);
+    objectFrom = std::string::npos;
+    current.detailJson = store->add(object);
+    releases.push_back(current);
+  }
+  stack.pop_back();
+  valueDone();
+}
+
+void ReleaseStreamParser::valueDone() {
+  justOpened = false;
+  expect = stack.empty() ? Expect::End : Expect::CommaOrClose;
+}
+
+// Only the list fields are kept: tag_name, name and created_at of a
+// release and commit.short_id, or GitHub's target_commitish in its place.
+bool ReleaseStreamParser::wantString() const {
+  size_t depth = stack.size();
+  if (depth == 2 && stack[1] == '{')
+    return keys[2] == "tag_name" || keys[2] == "name" ||
+           keys[2] == "created_at" || keys[2] == "target_commitish";
+  if (depth == 3 && stack[1] == '{' && stack[2] == '{')
+    return keys[2] == "commit" && keys[3] == "short_id";
+  return false;
+}
+
+void ReleaseStreamParser::stringDone() {
+  flushSurrogate();
+  justOpened = false;
+  if (stringIsKey) {
+    if (stack.size() < kKeyLevels)
+      keys[stack.size()] = scratch;
+    expect = Expect::Colon;
+    return;
+  }
+
+  if (keepString) {
+    const std::string& key = keys[stack.size()];
+    std::string_view value = intern(scratch);
+    if (stack.size() == 3)
+      current.commitId = value;
+    else if (key == "tag_name")
+      current.tag = value;
+    else if (key == "name")
+      current.name = value;
+    else if (key == "created_at")
+      current.createdAt = value;
+    else if (current.commitId.empty())
+      current.commitId = value;
+  }
+  valueDone();
+}
+
+void ReleaseStreamParser::flushSurrogate() {
+  // A high surrogate not followed by its low half.
+  if (highSurrogate) {
+    putUtf8(scratch, 0xFFFD);
+    highSurrogate = 0;
+  }
+}
+
+void ReleaseStreamParser::appendCodepoint(unsigned cp) {
+  if (cp >= 0xD800 && cp <= 0xDBFF) {
+    flushSurrogate();
+    highSurrogate = cp;
+    return;
+  }
+  if (cp >= 0xDC00 && cp <= 0xDFFF) {
+    if (!highSurrogate) {
+      putUtf8(scratch, 0xFFFD);
+      return;
+    }
+    cp = 0x10000 + ((highSurrogate - 0xD800) << 10) + (cp - 0xDC00);
+    highSurrogate = 0;
+  }
+  flushSurrogate();
+  putUtf8(scratch, cp);
+}
+
+std::string_view ReleaseStreamParser::intern(std::string_view s) {
+  if (s.empty())
+    return {};
+  auto it = interned.find(s);
+  if (it != interned.end())
+    return *it;
+  std::string_view stored = store->add(s);
+  interned.insert(stored);
+  return stored;
+}
+
+bool ReleaseStreamParser::finish(ReleaseList& out) {
+  if (failed || expect != Expect::End || mode != Mode::Normal)
+    return false;
+  out.releases = std::move(releases);
+  out.arenas.clear();
+  out.arenas.push_back(store);
+  releases.clear();
+  return true;
+}
+
+// -------------------- Paginated Release Feed --------------------
+
+namespace {
+
+struct PageRequest {
+  explicit PageRequest(std::shared_ptr<Arena> arena) : stream(std::move(arena)) {}
+
+  // Feeds the parser and times it for CompressionPolicy.
+  static size_t StreamWrite(void* ptr, size_t size, size_t nmemb,
+                            void* userdata) {
+    auto* self = static_cast<PageRequest*>(userdata);
+    auto begin = std::chrono::steady_clock::now();
+    self->stream.feed(static_cast<const char*>(ptr), size * nmemb);
+    self->parseTime += std::chrono::steady_clock::now() - begin;
+    self->decoded += size * nmemb;
+    return size * nmemb;
+  }
+
+  size_t source = 0;
+  size_t page = 0;
+  int attempt = 1;
+  int redirects = 0;
+  std::string url;
+  CurlEasy curl;
+  // Streaming pages parse as they arrive; buffered ones (the fallback)
+  // collect the whole body for parseReleases().
+  bool buffered = false;
+  ReleaseStreamParser stream;
+  MemoryBuffer body;
+  HeaderBuffer headers;
+  curl_off_t decoded = 0;
+  std::chrono::steady_clock::duration parseTime{};
+};
+
+// The network side of one source's fetch.
+struct SourceFetch {
+  SourceFetch() = default;
+  SourceFetch(const SourceFetch&) = delete;
+  SourceFetch& operator=(const SourceFetch&) = delete;
+  ~SourceFetch() {
+    curl_slist_free_all(headers);
+    curl_slist_free_all(firstHeaders);
+    curl_slist_free_all(foreignHeaders);
+  }
+
+  struct curl_slist* headers = nullptr;
+  struct curl_slist* firstHeaders = nullptr;
+  // Without the token, for redirects away from the API host.
+  struct curl_slist* foreignHeaders = nullptr;
+  // Every page of this fetch allocates from one arena, freed in one go
+  // when the last list holding it is replaced.
+  std::shared_ptr<Arena> arena = std::make_shared<Arena>();
+  std::string etag;
+  size_t totalPages = 0;
+  size_t lastPage = 1;
+  int inFlight = 0;
+  bool notModified = false;
+  bool failed = false;
+  bool complete = true;
+};
+
+} // namespace
+
+static std::string pageUrl(const std::string& apiUrl, size_t page) {
+  char query[64];
+  snprintf(query, sizeof(query), "per_page=%d&page=%zu", kReleasesPerPage,
+           page);
+  return apiUrl + (apiUrl.find('?') == std::string::npos ? "?" : "&") + query;
+}
+
+static std::unique_ptr<PageRequest> makePageRequest(const std::string& url,
+                                                    size_t page,
+                                                    struct curl_slist* headers,
+                                                    std::shared_ptr<Arena> arena,
+                                                    bool buffered = false) {
+  auto req = std::make_unique<PageRequest>(arena);
+  req->page = page;
+  req->url = url;
+  req->buffered = buffered;
+  CurlEasy& curl = req->curl;
+  curl.setopt(CURLOPT_HTTPHEADER, headers);
+  curl.setopt(CURLOPT_URL, req->url.c_str());
+  if (buffered) {
+    curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEFUNCTION,
+                     MemoryBuffer::WriteCallback);
+    curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEDATA, &req->body);
+  } else {
+    curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEFUNCTION,
+                     PageRequest::StreamWrite);
+    curl_easy_setopt(curl.getHandle(), CURLOPT_WRITEDATA, req.get());
+  }
+  curl_easy_setopt(curl.getHandle(), CURLOPT_HEADERFUNCTION,
+                   HeaderBuffer::HeaderCallback);
+  curl_easy_setopt(curl.getHandle(), CURLOPT_HEADERDATA, &req->headers);
+  // Parallel page fetches become streams on one connection over h2.
+  curl.preferHttp2();
+  curl.acceptCompressed();
+  return req;
+}
+
+// ISO 8601 timestamps sort as text. Only the seconds are compared, since
+// GitLab adds milliseconds and GitHub does not.
+static bool newerThan(const Release& a, const Release& b) {
+  return a.createdAt.substr(0, 19) > b.createdAt.substr(0, 19);
+}
+
+ReleaseFeed::~ReleaseFeed() {
+  stopping = true;
+  if (worker.joinable())
+    worker.join();
+}
+
+void ReleaseFeed::addSource(const Source& source, ReleaseList cached,
+                            const std::string& cachedEtag) {
+  SourceFeed feed;
+  feed.source = source;
+  feed.cachedEtag = cachedEtag;
+  feed.cached = std::move(cached);
+  sources.push_back(std::move(feed));
+}
+
+void ReleaseFeed::publishCached() {
+  std::lock_guard<std::mutex> lock(mtx);
+  // Nothing else merges before the worker runs.
+  if (generation == 0)
+    mergeLocked();
+}
+
+void ReleaseFeed::start() {
+  // Whatever was cached is there for the first poll.
+  publishCached();
+  worker = std::thread([this]() { run(); });
+}
+
+bool ReleaseFeed::poll(ReleaseList& out) {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (generation == seenGeneration)
+    return false;
+  seenGeneration = generation;
+  out = merged;
+  return true;
+}
+
+bool ReleaseFeed::hasFailed(size_t index) const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return index < sources.size() && sources[index].failed;
+}
+
+void ReleaseFeed::mergeLocked() {
+  ReleaseList all;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    const SourceFeed& s = sources[i];
+    const ReleaseList& shown =
+        s.replaced || s.cached.releases.empty() ? s.published : s.cached;
+    for (Release r : shown.releases) {
+      r.source = i;
+      all.releases.push_back(r);
+    }
+    all.arenas.insert(all.arenas.end(), shown.arenas.begin(),
+                      shown.arenas.end());
+  }
+  if (all.releases.empty() && merged.releases.empty())
+    return;
+  // Each source's list is already newest first; stable keeps its order
+  // where timestamps tie.
+  std::stable_sort(all.releases.begin(), all.releases.end(), newerThan);
+  merged = std::move(all);
+  ++generation;
+}
+
+void ReleaseFeed::publish(size_t source, size_t page, ReleaseList&& releases) {
+  std::lock_guard<std::mutex> lock(mtx);
+  SourceFeed& s = sources[source];
+  if (s.pages.size() < page) {
+    s.pages.resize(page);
+    s.arrived.resize(page, false);
+  }
+  s.pages[page - 1] = std::move(releases);
+  s.arrived[page - 1] = true;
+
+  bool advanced = false;
+  while (s.publishedPages < s.pages.size() && s.arrived[s.publishedPages]) {
+    s.published.append(std::move(s.pages[s.publishedPages]));
+    ++s.publishedPages;
+    advanced = true;
+  }
+  // A list that replaces a cached one is only shown when complete.
+  if (advanced && s.cached.releases.empty())
+    mergeLocked();
+}
+
+void ReleaseFeed::replaceCached(size_t source, ReleaseList& snapshot) {
+  std::lock_guard<std::mutex> lock(mtx);
+  SourceFeed& s = sources[source];
+  s.replaced = true;
+  if (!s.cached.releases.empty()) {
+    s.cached = ReleaseList();
+    mergeLocked();
+  }
+  snapshot = s.published;
+}
+
+void ReleaseFeed::run() {
+  CurlMulti multi;
+  curl_multi_setopt(multi.getHandle(), CURLMOPT_MAX_HOST_CONNECTIONS,
+                    kMaxParallelPages);
+  std::vector<SourceFetch> fetches(sources.size());
+  std::vector<std::unique_ptr<PageRequest>> inFlight;
+  // Failed pages waiting out their backoff; they still count as in flight
+  // for their source.
+  struct Delayed {
+    std::chrono::steady_clock::time_point due;
+    std::unique_ptr<PageRequest> req;
+  };
+  std::vector<Delayed> delayed;
+  curl_off_t wireBytes = 0, jsonBytes = 0;
+
+  auto add = [&](size_t source, std::unique_ptr<PageRequest> req) {
+    req->source = source;
+    ++fetches[source].inFlight;
+    multi.add(req->curl);
+    inFlight.push_back(std::move(req));
+  };
+
+  auto finish = [&](size_t i) {
+    SourceFetch& f = fetches[i];
+    const Source& source = sources[i].source;
+    if (f.failed) {
+      std::lock_guard<std::mutex> lock(mtx);
+      sources[i].failed = true;
+    }
+    if (!f.complete || f.failed || f.notModified || stopping)
+      return;
+    ReleaseList snapshot;
+    replaceCached(i, snapshot);
+    saveReleaseCache(source.cachePath(), source.apiUrl, snapshot.releases,
+                     f.etag);
+  };
+
+  // Only the first streamed request of page 1 is conditional, and the
+  // token only goes to the API host.
+  auto headersFor = [&](size_t source, size_t page, const std::string& url,
+                        bool buffered) {
+    SourceFetch& f = fetches[source];
+    if (urlHost(url) != urlHost(sources[source].source.apiUrl))
+      return f.foreignHeaders;
+    return page == 1 && !buffered ? f.firstHeaders : f.headers;
+  };
+
+  auto handleDone = [&](PageRequest& req, CURLcode res) {
+    SourceFetch& f = fetches[req.source];
+    const std::string& apiUrl = sources[req.source].source.apiUrl;
+    long code = req.curl.getResponseCode();
+    if (res == CURLE_OK && code == 304 && req.page == 1) {
+      f.notModified = true;
+      return;
+    }
+    // Followed here rather than by libcurl so the token stays on the API
+    // host; what the redirect's body fed the parser is dropped with it.
+    std::string next =
+        res == CURLE_OK ? redirectTarget(req.curl.getHandle()) : std::string();
+    if (!next.empty()) {
+      if (req.redirects < kMaxRedirects) {
+        struct curl_slist* headers =
+            headersFor(req.source, req.page, next, req.buffered);
+        auto moved =
+            makePageRequest(next, req.page, headers, f.arena, req.buffered);
+        moved->attempt = req.attempt;
+        moved->redirects = req.redirects + 1;
+        add(req.source, std::move(moved));
+        return;
+      }
+      res = CURLE_TOO_MANY_REDIRECTS;
+    }
+    if (res != CURLE_OK) {
+      std::cerr << "CURL error (" << apiUrl << " page " << req.page
+                << "): " << curl_easy_strerror(res) << "\n";
+    } else if (code != 200) {
+      std::cerr << "HTTP error (" << apiUrl << " page " << req.page
+                << "): " << code << "\n";
+    }
+    bool ok = res == CURLE_OK && code == 200;
+    CURLcode failure = res == CURLE_OK ? CURLE_HTTP_RETURNED_ERROR : res;
+    if (!ok && !stopping && req.attempt < kTransferPolicy.maxAttempts &&
+        isRetryableFailure(failure, code)) {
+      std::chrono::milliseconds delay =
+          retryDelay(req.attempt, kTransferPolicy);
+      std::cerr << "Retrying " << apiUrl << " page " << req.page << " in "
+                << delay.count() << " ms\n";
+      auto again =
+          makePageRequest(req.url, req.page,
+                          headersFor(req.source, req.page, req.url,
+                                     req.buffered),
+                          f.arena, req.buffered);
+      again->source = req.source;
+      again->attempt = req.attempt + 1;
+      ++f.inFlight;
+      delayed.push_back({std::chrono::steady_clock::now() + delay,
+                         std::move(again)});
+      return;
+    }
+    if (!ok && req.page == 1)
+      f.failed = true;
+    if (!ok) {
+      f.complete = false;
+      return;
+    }
+
+    curl_off_t wire = 0;
+    curl_easy_getinfo(req.curl.getHandle(), CURLINFO_SIZE_DOWNLOAD_T, &wire);
+    wireBytes += wire;
+    jsonBytes += req.buffered ? req.body.data.size() : req.decoded;
+    // Measured before the next pages are queued so they follow the verdict.
+    if (!req.buffered)
+      CompressionPolicy::get().record(req.curl.getHandle(), req.decoded,
+                                      req.parseTime);
+
+    // Further pages are queued from the first response for a page; a
+    // refetch only replaces its body.
+    if (!req.buffered && req.page == 1) {
+      f.etag = req.headers.get("ETag");
+      f.totalPages = std::strtoul(req.headers.get("X-Total-Pages").c_str(),
+                                  nullptr, 10);
+      for (size_t page = 2; page <= f.totalPages; ++page)
+        add(req.source, makePageRequest(pageUrl(apiUrl, page), page, f.headers,
+                                        f.arena));
+    }
+    if (!req.buffered && f.totalPages == 0 && !stopping) {
+      // No page count from the server: follow the Link chain one at a time.
+      std::string nextUrl = linkNextUrl(req.headers.get("Link"));
+      std::string nextPage = req.headers.get("X-Next-Page");
+      if (nextUrl.empty() && !nextPage.empty())
+        nextUrl = pageUrl(apiUrl, std::strtoul(nextPage.c_str(), nullptr, 10));
+      if (!nextUrl.empty()) {
+        ++f.lastPage;
+        add(req.source,
+            makePageRequest(nextUrl, f.lastPage,
+                            headersFor(req.source, f.lastPage, nextUrl, false),
+                            f.arena));
+      }
+    }
+
+    ReleaseList parsed;
+    if (req.buffered) {
+      parsed = parseReleases(req.body.data, f.arena);
+    } else if (!req.stream.finish(parsed)) {
+      // Fall back to the DOM parser; the body was not kept, so fetch the
+      // page again in full.
+      std::cerr << "Streaming parse failed (" << apiUrl << " page "
+                << req.page << "), refetching\n";
+      add(req.source,
+          makePageRequest(req.url, req.page,
+                          headersFor(req.source, req.page, req.url, true),
+                          f.arena, true));
+      return;
+    }
+    publish(req.source, req.page, std::move(parsed));
+  };
+
+  for (size_t i = 0; i < sources.size(); ++i) {
+    SourceFetch& f = fetches[i];
+    const SourceFeed& s = sources[i];
+    const ForgeAdapter& forge = s.source.adapter();
+    f.headers = forge.apiHeaders(s.source.token);
+    f.firstHeaders = forge.apiHeaders(s.source.token);
+    f.foreignHeaders = forge.apiHeaders(std::string());
+    if (!s.cachedEtag.empty()) {
+      f.firstHeaders = curl_slist_append(
+          f.firstHeaders, ("If-None-Match: " + s.cachedEtag).c_str());
+    }
+    add(i, makePageRequest(pageUrl(s.source.apiUrl, 1), 1, f.firstHeaders,
+                           f.arena));
+  }
+
+  while ((!inFlight.empty() || !delayed.empty()) && !stopping) {
+    auto now = std::chrono::steady_clock::now();
+    auto wake = now + std::chrono::milliseconds(100);
+    for (size_t i = 0; i < delayed.size();) {
+      if (delayed[i].due > now) {
+        wake = std::min(wake, delayed[i].due);
+        ++i;
+        continue;
+      }
+      multi.add(delayed[i].req->curl);
+      inFlight.push_back(std::move(delayed[i].req));
+      delayed.erase(delayed.begin() + i);
+    }
+    if (inFlight.empty()) {
+      std::this_thread::sleep_until(wake);
+      continue;
+    }
+    multi.perform(100);
+    while (CURLMsg* msg = multi.nextDone()) {
+      for (size_t i = 0; i < inFlight.size(); ++i) {
+        if (inFlight[i]->curl.getHandle() != msg->easy_handle)
+          continue;
+        CURLcode res = msg->data.result;
+        std::unique_ptr<PageRequest> req = std::move(inFlight[i]);
+        inFlight.erase(inFlight.begin() + i);
+        multi.remove(req->curl);
+        handleDone(*req, res);
+        if (--fetches[req->source].inFlight == 0)
+          finish(req->source);
+        break;
+      }
+    }
+  }
+
+  for (auto& req : inFlight)
+    multi.remove(req->curl);
+  inFlight.clear();
+  if (jsonBytes > 0)
+    std::cerr << "Release feed: " << wireBytes / 1024 << " KB on the wire for "
+              << jsonBytes / 1024 << " KB of JSON\n";
+  finished = true;
+}
@@ -0,0 +1,179 @@
+#ifndef RELEASES_H
+#define RELEASES_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "model.h"
+#include "sources.h"
+
+// -------------------- Parse Releases from JSON --------------------
+
+// Builds the list entries of one page in `arena` (a new one when null).
+// Descriptions and assets are left in each entry's detailJson for
+// parseReleaseDetail().
+ReleaseList parseReleases(const std::string& rawJson,
+                          std::shared_ptr<Arena> arena = nullptr);
+
+// Parses one release object (a detailJson, or a /releases/:tag response)
+// with its strings and asset array allocated from `arena`.
+bool parseReleaseDetail(std::string_view json, Arena& arena,
+                        ReleaseDetail& out);
+
+// The same for a GitHub release object, whose description is its "body"
+// and whose assets carry a browser_download_url.
+bool parseGitHubReleaseDetail(std::string_view json, Arena& arena,
+                              ReleaseDetail& out);
+
+// -------------------- Streaming Release Parser --------------------
+
+// Builds the same list as parseReleases() while the body is still arriving,
+// without a DOM and without keeping the body: only the list fields and each
+// release's object text (its detailJson) are copied, straight into the
+// given arena. Repeated strings are stored once.
+class ReleaseStreamParser {
+public:
+  explicit ReleaseStreamParser(std::shared_ptr<Arena> arena = nullptr);
+
+  ReleaseStreamParser(const ReleaseStreamParser&) = delete;
+  ReleaseStreamParser& operator=(const ReleaseStreamParser&) = delete;
+
+  // CURLOPT_WRITEFUNCTION adapter; pass the parser as CURLOPT_WRITEDATA.
+  static size_t WriteCallback(void* ptr, size_t size, size_t nmemb,
+                              void* userdata);
+
+  // Consumes the next piece of the body. Once the input turns out not to
+  // be a JSON array the rest is ignored and finish() fails.
+  void feed(const char* data, size_t n);
+
+  // Moves the parsed releases into `out`; false when the body was
+  // malformed or incomplete, in which case parseReleases() is the fallback.
+  bool finish(ReleaseList& out);
+
+private:
+  enum class Mode { Normal, String, Escape, Unicode, Literal };
+  enum class Expect { Value, Key, Colon, CommaOrClose, End };
+
+  // Deepest level whose key is remembered: the array, a release and its
+  // "commit" object.
+  static const size_t kKeyLevels = 4;
+
+  void fail() { failed = true; }
+  void open(char c, size_t pos);
+  void close(char c, const char* data, size_t pos);
+  void valueDone();
+  void stringDone();
+  void appendCodepoint(unsigned cp);
+  void flushSurrogate();
+  bool wantString() const;
+  std::string_view intern(std::string_view s);
+
+  std::shared_ptr<Arena> store;
+  std::vector<Release> releases;
+  std::unordered_set<std::string_view> interned;
+
+  Mode mode = Mode::Normal;
+  Expect expect = Expect::Value;
+  bool justOpened = false;
+  bool failed = false;
+  std::vector<char> stack;
+  std::string keys[kKeyLevels];
+
+  bool stringIsKey = false;
+  bool keepString = false;
+  std::string scratch;
+  unsigned unicode = 0;
+  int unicodeDigits = 0;
+  unsigned highSurrogate = 0;
+
+  // Text of the release object being read, gathered across chunks.
+  std::string object;
+  size_t objectFrom = std::string::npos; // start in the current chunk
+  Release current;
+};
+
+// -------------------- Paginated Release Feed --------------------
+
+// Fetches every page of each source's /releases listing on one background
+// thread and one curl_multi handle, so all sources refresh in the same
+// network round. Per source, the first page is requested alone to learn
+// X-Total-Pages; the remaining pages are then fetched concurrently and
+// parsed as their bytes arrive (ReleaseStreamParser); a page the streaming
+// parser rejects is fetched again whole and handed to parseReleases().
+// Servers that omit the page count (GitHub among them) are walked through
+// their Link rel="next" chain instead.
+//
+// With a cached ETag a source's first request is conditional: a 304 ends
+// its fetch straight away and the cached list stays in place. Otherwise
+// the new list replaces the cached one once all its pages are in; a source
+// with nothing cached shows its pages as they arrive, in order.
+class ReleaseFeed {
+public:
+  ReleaseFeed() = default;
+  ~ReleaseFeed();
+
+  ReleaseFeed(const ReleaseFeed&) = delete;
+  ReleaseFeed& operator=(const ReleaseFeed&) = delete;
+
+  // Must be called before start(). `cached` is what loadReleaseCache()
+  // found for the source, if anything, with its ETag; the refreshed list
+  // is saved to the source's cachePath().
+  void addSource(const Source& source, ReleaseList cached,
+                 const std::string& cachedEtag);
+
+  // Makes what was cached for the sources available to poll() without
+  // touching the network, so it can be drawn while that comes up. start()
+  // does it as well when it has not been done.
+  void publishCached();
+
+  void start();
+
+  // Copies the releases of every source, newest first and tagged with
+  // their source's index, into `out` and returns true when they changed
+  // since the previous call.
+  bool poll(ReleaseList& out);
+
+  bool isFinished() const { return finished; }
+  // True when source `index` could not be refreshed.
+  bool hasFailed(size_t index) const;
+
+private:
+  struct SourceFeed {
+    Source source;
+    std::string cachedEtag;
+    ReleaseList cached;
+    // Pages of the running fetch; published ones are moved to `published`
+    // strictly in order.
+    std::vector<ReleaseList> pages;
+    std::vector<bool> arrived;
+    size_t publishedPages = 0;
+    ReleaseList published;
+    bool replaced = false; // `published` is complete and supersedes `cached`
+    bool failed = false;
+  };
+
+  void run();
+  void publish(size_t source, size_t page, ReleaseList&& releases);
+  // Swaps in a source's finished list and copies it to `snapshot`.
+  void replaceCached(size_t source, ReleaseList& snapshot);
+  void mergeLocked();
+
+  std::vector<SourceFeed> sources;
+  std::thread worker;
+
+  mutable std::mutex mtx;
+  ReleaseList merged;
+  unsigned generation = 0;
+  unsigned seenGeneration = 0;
+
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> finished{false};
+};
+
+#endif // RELEASES_H
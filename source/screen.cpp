@@ -0,0 +1,198 @@
+#include <switch.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "cache.h"
+#include "glrender.h"
+#include "screen.h"
+
+// -------------------- Console Screen --------------------
+
+Screen::Screen(int columns, int rows)
+    : width(columns), height(rows), next(rows), shown(rows) {
+  gauges.reserve(rows);
+  shownGauges.reserve(rows);
+}
+
+#ifdef NRL_GL_UI
+Screen::Screen(std::unique_ptr<GlRenderer> renderer)
+    : Screen(renderer->columns(), renderer->rows()) {
+  gpu = std::move(renderer);
+}
+#endif
+
+Screen Screen::open() {
+#ifdef NRL_GL_UI
+  auto renderer = std::make_unique<GlRenderer>();
+  if (renderer->init(nwindowGetDefault()))
+    return Screen(std::move(renderer));
+  std::cerr << "GPU renderer unavailable; using the console\n";
+  renderer.reset();
+#endif
+  PrintConsole* console = consoleInit(nullptr);
+  // Every thread reports errors on std::cerr, which would land in the rows
+  // the shadow buffer thinks it owns. They go to a file until
+  // nxlinkStdio() points stderr at a host.
+  ensureAppDataDirectory();
+  std::string log = std::string(kAppDataDir) + "/errors.log";
+  int fd = ::open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd >= 0) {
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+  }
+  return Screen(console->consoleWidth, console->consoleHeight);
+}
+
+Screen::~Screen() {
+#ifdef NRL_GL_UI
+  if (gpu)
+    return;
+#endif
+  consoleExit(nullptr);
+}
+
+void Screen::clear() {
+  // Keep each line's capacity; frames are rebuilt many times a second.
+  for (auto& l : next)
+    l.clear();
+  gauges.clear();
+}
+
+std::string& Screen::line(int row) {
+  if (row < 0 || row >= height) {
+    offscreen.clear();
+    return offscreen;
+  }
+  return next[row];
+}
+
+int Screen::wrap(int row, std::string_view text, int endRow, bool* clipped) {
+  // Writing the last column moves the console cursor on and can scroll the
+  // whole screen, so lines stop one short.
+  size_t limit = width - 1;
+  bool more = false;
+  while (row < endRow && !text.empty()) {
+    size_t nl = text.find('\n');
+    std::string_view para = text.substr(0, nl);
+    text = nl == std::string_view::npos ? std::string_view() : text.substr(nl + 1);
+
+    do {
+      std::string_view part = para;
+      if (part.size() > limit) {
+        size_t cut = part.rfind(' ', limit);
+        part = part.substr(0, cut == std::string_view::npos || cut == 0 ? limit
+                                                                       : cut);
+      }
+      std::string& l = line(row++);
+      for (char c : part) {
+        if (c == '\t')
+          l += ' ';
+        else if (c != '\r')
+          l += c;
+      }
+      para.remove_prefix(part.size());
+      if (!para.empty() && para.front() == ' ')
+        para.remove_prefix(1);
+    } while (!para.empty() && row < endRow);
+    more = !para.empty();
+  }
+  if (clipped)
+    *clipped = more || !text.empty();
+  return row;
+}
+
+void Screen::gauge(int row, int column, int cells, double fraction) {
+  if (fraction < 0)
+    fraction = 0;
+  if (fraction > 1)
+    fraction = 1;
+  std::string& l = line(row);
+  l.resize(column, ' ');
+  for (int i = 0; i < cells; ++i)
+    l += i < fraction * cells ? '=' : ' ';
+  if (row >= 0 && row < height && (int)gauges.size() < height)
+    gauges.push_back({row, column, cells, static_cast<float>(fraction)});
+}
+
+bool Screen::present() {
+#ifdef NRL_GL_UI
+  if (gpu)
+    return presentGpu();
+#endif
+  bool changed = repaint;
+  if (repaint) {
+    consoleClear();
+    for (auto& l : shown)
+      l.clear();
+    repaint = false;
+  }
+
+  size_t limit = width - 1;
+  for (int r = 0; r < height; ++r) {
+    std::string& want = next[r];
+    std::string& have = shown[r];
+    if (want.size() > limit)
+      want.resize(limit);
+    if (want == have)
+      continue;
+    changed = true;
+
+    size_t from = 0;
+    while (from < want.size() && from < have.size() && want[from] == have[from])
+      ++from;
+    printf("\x1b[%d;%zuH", r + 1, from + 1);
+    fwrite(want.data() + from, 1, want.size() - from, stdout);
+    for (size_t i = want.size() > from ? want.size() : from; i < have.size(); ++i)
+      fputc(' ', stdout);
+    have = want;
+  }
+  // Rendering the console to the framebuffer is the expensive part; an
+  // unchanged frame skips it.
+  if (!changed)
+    return false;
+  fflush(stdout);
+  consoleUpdate(nullptr);
+  return true;
+}
+
+#ifdef NRL_GL_UI
+// The GPU redraws the whole grid each time, so only "anything changed"
+// matters; the copies reuse their capacity and do not allocate.
+bool Screen::presentGpu() {
+  bool changed = repaint || gauges != shownGauges;
+  repaint = false;
+  for (int r = 0; r < height; ++r) {
+    if (next[r].size() > (size_t)width)
+      next[r].resize(width);
+    if (next[r] != shown[r]) {
+      shown[r] = next[r];
+      changed = true;
+    }
+  }
+  if (!changed)
+    return false;
+  shownGauges = gauges;
+  gpu->draw(shown, shownGauges);
+  return true;
+}
+#endif
+
+// -------------------- Scrolling Viewport --------------------
+
+void Viewport::follow(int selected, int count, int visible) {
+  if (visible < 1)
+    visible = 1;
+  if (selected < top)
+    top = selected;
+  if (selected >= top + visible)
+    top = selected - visible + 1;
+  if (top > count - visible)
+    top = count - visible;
+  if (top < 0)
+    top = 0;
+}
@@ -0,0 +1,102 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class GlRenderer;
+
+// Progress bar drawn over `width` cells of a row.
+struct Gauge {
+  int row = 0;
+  int column = 0;
+  int width = 0;
+  float fraction = 0;
+
+  bool operator==(const Gauge& o) const {
+    return row == o.row && column == o.column && width == o.width &&
+           fraction == o.fraction;
+  }
+  bool operator!=(const Gauge& o) const { return !(*this == o); }
+};
+
+// -------------------- Console Screen --------------------
+
+// Shadow copy of the console grid. A frame is built line by line and
+// present() rewrites only what differs from the previous frame: each changed
+// line is entered with an ANSI cursor move at its first changed column, and
+// leftovers of a longer old line are blanked. Nothing is cleared, so there
+// is no flicker and unchanged rows cost nothing.
+//
+// Built with NRL_GL_UI, the same frames can go to a GlRenderer instead,
+// which redraws the whole grid on the GPU whenever anything changed.
+class Screen {
+public:
+  // Draws through the GPU renderer when built with NRL_GL_UI and EGL comes
+  // up, on the text console otherwise. Either is shut down with the Screen.
+  static Screen open();
+  ~Screen();
+
+  Screen(const Screen&) = delete;
+  Screen& operator=(const Screen&) = delete;
+
+  int rows() const { return height; }
+  int columns() const { return width; }
+
+  // Starts a new frame with every line empty.
+  void clear();
+
+  // Text of `row` in the frame being built; append to it. Off-screen rows
+  // go to a scratch line that is never shown.
+  std::string& line(int row);
+  void print(int row, std::string_view text) { line(row).assign(text); }
+
+  // Word-wraps `text` (honouring its newlines) into rows starting at `row`
+  // and stops before `endRow`. Returns the row after the last one written;
+  // `clipped` reports whether text was left over.
+  int wrap(int row, std::string_view text, int endRow,
+           bool* clipped = nullptr);
+
+  // Writes a `width`-cell progress bar at `column` of `row`, replacing
+  // anything after it. The console shows it as '=' cells.
+  void gauge(int row, int column, int width, double fraction);
+
+  // Returns false (and skips consoleUpdate) when the frame is unchanged.
+  bool present();
+
+  // Forces a full repaint next time, e.g. after something printed to the
+  // console behind our back.
+  void invalidate() { repaint = true; }
+
+private:
+  Screen(int columns, int rows);
+#ifdef NRL_GL_UI
+  explicit Screen(std::unique_ptr<GlRenderer> gpu);
+  bool presentGpu();
+
+  std::unique_ptr<GlRenderer> gpu;
+#endif
+
+  int width;
+  int height;
+  std::vector<std::string> next;
+  std::vector<std::string> shown;
+  std::vector<Gauge> gauges;
+  std::vector<Gauge> shownGauges;
+  std::string offscreen;
+  bool repaint = true;
+};
+
+// -------------------- Scrolling Viewport --------------------
+
+// First visible entry of a list, scrolled only as far as needed to keep the
+// selection on screen.
+struct Viewport {
+  int top = 0;
+
+  void follow(int selected, int count, int visible);
+};
+
+#endif // SCREEN_H
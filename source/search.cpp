@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <iterator>
+
+#include "search.h"
+
+// -------------------- Release Search --------------------
+
+static char lowerAscii(char c) {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static void appendLower(std::string& out, std::string_view s) {
+  for (char c : s)
+    out += lowerAscii(c);
+}
+
+static uint32_t trigramAt(std::string_view s, size_t i) {
+  return (uint32_t)(unsigned char)s[i] << 16 |
+         (uint32_t)(unsigned char)s[i + 1] << 8 | (unsigned char)s[i + 2];
+}
+
+// "YYYY[-MM[-DD]]" as YYYYMMDD. Missing parts are the first (or, for
+// `end`, the last) month and day. 0 when it is not a date.
+static int parseDate(std::string_view s, bool end) {
+  int parts[3] = {0, end ? 12 : 1, end ? 31 : 1};
+  size_t at = 0;
+  for (int p = 0; p < 3 && at < s.size(); ++p) {
+    int value = 0, digits = 0;
+    while (at < s.size() && s[at] >= '0' && s[at] <= '9') {
+      value = value * 10 + (s[at++] - '0');
+      ++digits;
+    }
+    if (digits == 0)
+      return 0;
+    parts[p] = value;
+    if (at < s.size() && s[at] != '-')
+      break; // e.g. the 'T' of a timestamp
+    ++at;
+  }
+  if (parts[0] < 1000)
+    return 0;
+  return parts[0] * 10000 + parts[1] * 100 + parts[2];
+}
+
+SearchQuery parseSearchQuery(std::string_view text) {
+  SearchQuery q;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t begin = text.find_first_not_of(' ', pos);
+    if (begin == std::string_view::npos)
+      break;
+    size_t end = text.find(' ', begin);
+    if (end == std::string_view::npos)
+      end = text.size();
+    pos = end;
+
+    std::string word;
+    appendLower(word, text.substr(begin, end - begin));
+    if (word.rfind("since:", 0) == 0 && parseDate(word.substr(6), false))
+      q.since = parseDate(word.substr(6), false);
+    else if (word.rfind("until:", 0) == 0 && parseDate(word.substr(6), true))
+      q.until = parseDate(word.substr(6), true);
+    else if (word == "has:nro")
+      q.nroOnly = true;
+    else
+      q.words.push_back(std::move(word));
+  }
+  return q;
+}
+
+void ReleaseIndex::build(const std::vector<Release>& releases,
+                         const std::vector<Source>& sources,
+                         bool (*launchable)(const Asset& a)) {
+  text.clear();
+  entries.clear();
+  trigrams.clear();
+  entries.reserve(releases.size());
+
+  Arena scratch;
+  for (size_t i = 0; i < releases.size(); ++i) {
+    const Release& r = releases[i];
+    Entry e;
+    e.begin = text.size();
+    appendLower(text, r.tag);
+    text += '\n';
+    appendLower(text, r.name);
+    text += '\n';
+    appendLower(text, r.commitId);
+
+    ReleaseDetail detail;
+    if (!r.detailJson.empty() && r.source < sources.size() &&
+        sources[r.source].adapter().parseDetail(r.detailJson, scratch,
+                                                detail)) {
+      for (auto& a : detail.assets) {
+        text += '\n';
+        appendLower(text, a.name);
+        e.launchable = e.launchable || launchable(a);
+      }
+    }
+    scratch.reset();
+    e.end = text.size();
+    e.date = parseDate(r.createdAt, false);
+    entries.push_back(e);
+
+    std::string_view s(text.data() + e.begin, e.end - e.begin);
+    for (size_t p = 0; p + 3 <= s.size(); ++p) {
+      if (s[p] == '\n' || s[p + 1] == '\n' || s[p + 2] == '\n')
+        continue;
+      trigrams.push_back((uint64_t)trigramAt(s, p) << 32 | i);
+    }
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+}
+
+void ReleaseIndex::postings(uint32_t t, std::vector<uint32_t>& out) const {
+  out.clear();
+  auto from = std::lower_bound(trigrams.begin(), trigrams.end(),
+                               (uint64_t)t << 32);
+  for (auto it = from; it != trigrams.end() && (*it >> 32) == t; ++it)
+    out.push_back((uint32_t)*it);
+}
+
+bool ReleaseIndex::passesFilters(const Entry& e,
+                                 const SearchQuery& query) const {
+  if (query.since && e.date < query.since)
+    return false;
+  if (query.until && e.date > query.until)
+    return false;
+  return !query.nroOnly || e.launchable;
+}
+
+bool ReleaseIndex::containsAll(const Entry& e,
+                               const SearchQuery& query) const {
+  std::string_view s(text.data() + e.begin, e.end - e.begin);
+  for (auto& w : query.words) {
+    if (s.find(w) == std::string_view::npos)
+      return false;
+  }
+  return true;
+}
+
+bool ReleaseIndex::search(const SearchQuery& query, std::vector<uint32_t>& out,
+                          bool fuzzy) const {
+  out.clear();
+
+  // Candidates hold every trigram of every long enough word.
+  std::vector<uint32_t> candidates, list, both;
+  bool narrowed = false;
+  for (auto& w : query.words) {
+    for (size_t p = 0; p + 3 <= w.size(); ++p) {
+      postings(trigramAt(w, p), list);
+      if (!narrowed) {
+        candidates.swap(list);
+        narrowed = true;
+        continue;
+      }
+      both.clear();
+      std::set_intersection(candidates.begin(), candidates.end(), list.begin(),
+                            list.end(), std::back_inserter(both));
+      candidates.swap(both);
+    }
+  }
+
+  auto consider = [&](uint32_t id) {
+    const Entry& e = entries[id];
+    if (passesFilters(e, query) && containsAll(e, query))
+      out.push_back(id);
+  };
+  if (narrowed) {
+    for (uint32_t id : candidates)
+      consider(id);
+  } else {
+    for (uint32_t id = 0; id < entries.size(); ++id)
+      consider(id);
+  }
+  if (!out.empty() || !fuzzy || !narrowed)
+    return false;
+
+  // Nothing contains the words as typed: take what shares at least half
+  // of their distinct trigrams.
+  std::vector<uint32_t> wanted;
+  for (auto& w : query.words) {
+    for (size_t p = 0; p + 3 <= w.size(); ++p)
+      wanted.push_back(trigramAt(w, p));
+  }
+  std::sort(wanted.begin(), wanted.end());
+  wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+  std::vector<uint16_t> hits(entries.size(), 0);
+  for (uint32_t t : wanted) {
+    postings(t, list);
+    for (uint32_t id : list)
+      ++hits[id];
+  }
+  size_t needed = (wanted.size() + 1) / 2;
+  for (uint32_t id = 0; id < entries.size(); ++id) {
+    if (hits[id] >= needed && passesFilters(entries[id], query))
+      out.push_back(id);
+  }
+  return !out.empty();
+}
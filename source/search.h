@@ -0,0 +1,73 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "model.h"
+#include "sources.h"
+
+// -------------------- Release Search --------------------
+
+// What the search box holds, split into words and filters. Besides plain
+// words it understands `since:YYYY[-MM[-DD]]`, `until:YYYY[-MM[-DD]]` and
+// `has:nro`.
+struct SearchQuery {
+  std::vector<std::string> words; // lowercased
+  int since = 0;                  // YYYYMMDD, 0 for open
+  int until = 0;
+  bool nroOnly = false;
+
+  bool empty() const {
+    return words.empty() && since == 0 && until == 0 && !nroOnly;
+  }
+};
+
+SearchQuery parseSearchQuery(std::string_view text);
+
+// Case-insensitive index over each release's tag, name, commit and asset
+// names. Every three-byte sequence of that text is posted in one sorted
+// array, so a word of three or more letters narrows the candidates to the
+// releases holding all its trigrams with a few binary searches; the
+// candidates are then checked for the word itself. Shorter words are only
+// checked. Built once per release list and not updated.
+class ReleaseIndex {
+public:
+  // Assets are read from the entries' detailJson with their source's
+  // adapter; releases without one are indexed by their list fields only
+  // and never pass the has:nro filter. `launchable` decides that filter.
+  void build(const std::vector<Release>& releases,
+             const std::vector<Source>& sources,
+             bool (*launchable)(const Asset& a));
+
+  // Indices into the release vector matching every word and filter, in
+  // list order. When nothing matches exactly and `fuzzy` is set, falls
+  // back to releases sharing most of the query's trigrams, which forgives
+  // a typo or two; returns whether that fallback was used.
+  bool search(const SearchQuery& query, std::vector<uint32_t>& out,
+              bool fuzzy = true) const;
+
+  size_t size() const { return entries.size(); }
+
+private:
+  struct Entry {
+    uint32_t begin = 0; // span in `text`
+    uint32_t end = 0;
+    int date = 0; // YYYYMMDD of createdAt
+    bool launchable = false;
+  };
+
+  bool passesFilters(const Entry& e, const SearchQuery& query) const;
+  bool containsAll(const Entry& e, const SearchQuery& query) const;
+  // Sorted entry ids of everything holding trigram `t`.
+  void postings(uint32_t t, std::vector<uint32_t>& out) const;
+
+  std::string text; // lowercased, '\n' between fields
+  std::vector<Entry> entries;
+  // (trigram << 32 | entry id), sorted, without duplicates.
+  std::vector<uint64_t> trigrams;
+};
+
+#endif // SEARCH_H
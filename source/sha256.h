@@ -0,0 +1,29 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+// -------------------- SHA-256 --------------------
+
+// On the Switch this is libnx's hardware-backed implementation. Host builds
+// (see bench/) get a portable one with the same interface, so code that
+// hashes as it writes compiles and measures the same way off the console.
+#ifdef __SWITCH__
+#include <switch.h>
+#else
+#include <cstddef>
+#include <cstdint>
+
+#define SHA256_HASH_SIZE 0x20
+
+struct Sha256Context {
+  uint32_t state[8];
+  uint8_t block[64];
+  size_t buffered;
+  uint64_t length;
+};
+
+void sha256ContextCreate(Sha256Context* ctx);
+void sha256ContextUpdate(Sha256Context* ctx, const void* src, size_t size);
+void sha256ContextGetHash(Sha256Context* ctx, void* dst);
+#endif
+
+#endif // SHA256_H
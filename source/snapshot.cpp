@@ -0,0 +1,131 @@
+#include <cstring>
+#include <unordered_map>
+
+#include "snapshot.h"
+
+static const char kSnapshotMagic[4] = {'N', 'R', 'L', 'S'};
+
+// -------------------- Encode --------------------
+
+namespace {
+
+class StringTable {
+public:
+  SnapshotString add(std::string_view s) {
+    if (s.empty())
+      return {0, 0};
+    auto it = offsets.find(s);
+    if (it != offsets.end())
+      return {it->second, static_cast<uint32_t>(s.size())};
+
+    uint32_t offset = data.size();
+    data.append(s);
+    // Key on the caller's bytes; they outlive the table.
+    offsets.emplace(s, offset);
+    return {offset, static_cast<uint32_t>(s.size())};
+  }
+
+  std::string data;
+
+private:
+  std::unordered_map<std::string_view, uint32_t> offsets;
+};
+
+} // namespace
+
+template <typename T>
+static void putRecord(std::string& out, const T& rec) {
+  out.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+}
+
+std::string encodeSnapshot(const std::vector<Release>& releases,
+                           std::string_view apiUrl, std::string_view etag) {
+  StringTable strings;
+  std::vector<SnapshotRelease> outReleases;
+  outReleases.reserve(releases.size());
+
+  SnapshotHeader header;
+  memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.apiUrl = strings.add(apiUrl);
+  header.etag = strings.add(etag);
+
+  for (auto& r : releases) {
+    SnapshotRelease rec;
+    rec.tag = strings.add(r.tag);
+    rec.name = strings.add(r.name);
+    rec.createdAt = strings.add(r.createdAt);
+    rec.commitId = strings.add(r.commitId);
+    rec.detailJson = strings.add(r.detailJson);
+    outReleases.push_back(rec);
+  }
+
+  header.releaseCount = outReleases.size();
+  header.stringsSize = strings.data.size();
+
+  std::string out;
+  out.reserve(sizeof(header) + outReleases.size() * sizeof(SnapshotRelease) +
+              strings.data.size());
+  putRecord(out, header);
+  for (auto& rec : outReleases)
+    putRecord(out, rec);
+  out.append(strings.data);
+  return out;
+}
+
+// -------------------- Decode --------------------
+
+bool decodeSnapshot(std::unique_ptr<char[]> blob, size_t size,
+                    ReleaseList& out, std::string_view& apiUrl,
+                    std::string_view& etag) {
+  const char* base = blob.get();
+  auto store = std::make_shared<Arena>();
+  store->adopt(std::move(blob));
+  out.releases.clear();
+  out.arenas.clear();
+  out.arenas.push_back(store);
+
+  SnapshotHeader header;
+  if (size < sizeof(header))
+    return false;
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 ||
+      header.version != kSnapshotVersion)
+    return false;
+
+  uint64_t releasesBytes =
+      uint64_t(header.releaseCount) * sizeof(SnapshotRelease);
+  if (sizeof(header) + releasesBytes + header.stringsSize != size)
+    return false;
+
+  // The records are 4-byte aligned within a blob from operator new[].
+  auto* recs = reinterpret_cast<const SnapshotRelease*>(base + sizeof(header));
+  const char* strings = base + sizeof(header) + releasesBytes;
+
+  bool valid = true;
+  auto view = [&](const SnapshotString& s) -> std::string_view {
+    if (uint64_t(s.offset) + s.length > header.stringsSize) {
+      valid = false;
+      return {};
+    }
+    return std::string_view(strings + s.offset, s.length);
+  };
+
+  apiUrl = view(header.apiUrl);
+  etag = view(header.etag);
+
+  out.releases.resize(header.releaseCount);
+  for (uint32_t i = 0; i < header.releaseCount && valid; ++i) {
+    const SnapshotRelease& rec = recs[i];
+    Release& r = out.releases[i];
+    r.tag = view(rec.tag);
+    r.name = view(rec.name);
+    r.createdAt = view(rec.createdAt);
+    r.commitId = view(rec.commitId);
+    r.detailJson = view(rec.detailJson);
+  }
+
+  if (!valid)
+    out.releases.clear();
+  return valid;
+}
@@ -0,0 +1,59 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "model.h"
+
+// -------------------- Release Snapshot Format --------------------
+//
+// A snapshot is one flat, versioned blob in host byte order:
+//
+//   SnapshotHeader
+//   SnapshotRelease[releaseCount]
+//   char strings[stringsSize]    (shared, deduplicated string table)
+//
+// Every string is an (offset, length) pair into the table, so loading is a
+// single read plus bounds checks; the decoded Release entries are views
+// straight into the blob. Details are stored as the release's raw JSON and
+// parsed on demand like a freshly fetched list.
+
+static const uint32_t kSnapshotVersion = 3;
+
+struct SnapshotString {
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct SnapshotHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t releaseCount;
+  uint32_t stringsSize;
+  SnapshotString apiUrl;
+  SnapshotString etag;
+};
+
+struct SnapshotRelease {
+  SnapshotString tag;
+  SnapshotString name;
+  SnapshotString createdAt;
+  SnapshotString commitId;
+  SnapshotString detailJson;
+};
+
+std::string encodeSnapshot(const std::vector<Release>& releases,
+                           std::string_view apiUrl, std::string_view etag);
+
+// Validates `blob` and fills `out` with views into it; `out` takes ownership
+// of the blob either way. `apiUrl` and `etag` also point into the blob.
+bool decodeSnapshot(std::unique_ptr<char[]> blob, size_t size,
+                    ReleaseList& out, std::string_view& apiUrl,
+                    std::string_view& etag);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <iostream>
+
+#include "cache.h"
+#include "net.h"
+#include "releases.h"
+#include "sources.h"
+
+// -------------------- Forge Adapters --------------------
+
+static std::string escapedTagUrl(const std::string& base,
+                                 const std::string& tag) {
+  char* escaped = curl_easy_escape(nullptr, tag.c_str(), tag.size());
+  std::string url = base + (escaped ? escaped : tag.c_str());
+  curl_free(escaped);
+  return url;
+}
+
+static std::string gitLabReleaseUrl(const std::string& apiUrl,
+                                    const std::string& tag) {
+  return escapedTagUrl(apiUrl + "/", tag);
+}
+
+// GitHub refuses API requests without a User-Agent.
+static struct curl_slist* gitHubApiHeaders(const std::string& token) {
+  struct curl_slist* headers = nullptr;
+  if (!token.empty()) {
+    headers =
+        curl_slist_append(headers, ("Authorization: Bearer " + token).c_str());
+  }
+  headers = curl_slist_append(headers, "Accept: application/vnd.github+json");
+  headers = curl_slist_append(headers, "X-GitHub-Api-Version: 2022-11-28");
+  headers = curl_slist_append(headers, "User-Agent: Switch-NRO-Launcher");
+  return headers;
+}
+
+static std::string gitHubReleaseUrl(const std::string& apiUrl,
+                                    const std::string& tag) {
+  return escapedTagUrl(apiUrl + "/tags/", tag);
+}
+
+static const ForgeAdapter kGitLab = {makeApiHeaders, gitLabReleaseUrl,
+                                     parseReleaseDetail};
+static const ForgeAdapter kGitHub = {gitHubApiHeaders, gitHubReleaseUrl,
+                                     parseGitHubReleaseDetail};
+
+const ForgeAdapter& forgeAdapter(Forge forge) {
+  return forge == Forge::GitHub ? kGitHub : kGitLab;
+}
+
+// -------------------- Release Sources --------------------
+
+std::string Source::cachePath() const {
+  std::string path = std::string(kAppDataDir) + "/releases";
+  if (!label.empty()) {
+    path += '-';
+    for (char c : label) {
+      bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                   (c >= '0' && c <= '9') || c == '-' || c == '_';
+      path += plain ? c : '_';
+    }
+  }
+  return path + ".cache";
+}
+
+std::string Source::storeTag(std::string_view tag) const {
+  if (label.empty())
+    return std::string(tag);
+  return label + "/" + std::string(tag);
+}
+
+static std::vector<std::string_view> splitFields(std::string_view line) {
+  std::vector<std::string_view> fields;
+  size_t pos = 0;
+  while (pos < line.size()) {
+    size_t begin = line.find_first_not_of(" \t", pos);
+    if (begin == std::string_view::npos)
+      break;
+    size_t end = line.find_first_of(" \t", begin);
+    if (end == std::string_view::npos)
+      end = line.size();
+    fields.push_back(line.substr(begin, end - begin));
+    pos = end;
+  }
+  return fields;
+}
+
+bool loadSources(std::vector<Source>& out) {
+  std::string path = std::string(kAppDataDir) + "/sources.txt";
+  FILE* fp = fopen(path.c_str(), "r");
+  if (!fp)
+    return false;
+  char buf[1024];
+  int lineNo = 0;
+  while (fgets(buf, sizeof(buf), fp)) {
+    ++lineNo;
+    std::string_view line(buf);
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+      line.remove_suffix(1);
+    std::vector<std::string_view> f = splitFields(line);
+    if (f.empty() || f[0][0] == '#')
+      continue;
+    if (f.size() < 3 || f.size() > 4 || (f[0] != "gitlab" && f[0] != "github")) {
+      std::cerr << path << ":" << lineNo << ": expected "
+                << "'gitlab|github <label> <project> [token]'\n";
+      continue;
+    }
+
+    Source s;
+    s.forge = f[0] == "github" ? Forge::GitHub : Forge::GitLab;
+    s.label = std::string(f[1]);
+    s.apiUrl = std::string(f[2]);
+    if (s.forge == Forge::GitHub && s.apiUrl.find("://") == std::string::npos)
+      s.apiUrl = "https://api.github.com/repos/" + s.apiUrl + "/releases";
+    while (!s.apiUrl.empty() && s.apiUrl.back() == '/')
+      s.apiUrl.pop_back();
+    if (f.size() == 4)
+      s.token = std::string(f[3]);
+    out.push_back(std::move(s));
+  }
+  fclose(fp);
+  return true;
+}
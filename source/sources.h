@@ -0,0 +1,58 @@
+#ifndef SOURCES_H
+#define SOURCES_H
+
+#include <curl/curl.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "model.h"
+
+// -------------------- Release Sources --------------------
+
+enum class Forge { GitLab, GitHub };
+
+// What differs between the forges' release APIs. Both list releases as a
+// JSON array of objects with tag_name, name and created_at, paged with
+// per_page/page and a Link header, so the list goes through the same
+// parsers; authentication, the single-release URL and the release object
+// itself do not.
+struct ForgeAdapter {
+  // Headers for API requests; the caller frees the list.
+  struct curl_slist* (*apiHeaders)(const std::string& token);
+  // The release behind `tag`, below the source's releases endpoint.
+  std::string (*releaseUrl)(const std::string& apiUrl, const std::string& tag);
+  bool (*parseDetail)(std::string_view json, Arena& arena, ReleaseDetail& out);
+};
+
+const ForgeAdapter& forgeAdapter(Forge forge);
+
+// One project whose releases are listed.
+struct Source {
+  // Shown next to its releases and prefixed to their store keys; empty
+  // for the built-in source.
+  std::string label;
+  Forge forge = Forge::GitLab;
+  // The project's releases endpoint.
+  std::string apiUrl;
+  std::string token;
+
+  const ForgeAdapter& adapter() const { return forgeAdapter(forge); }
+  // Where this source's list is cached between runs.
+  std::string cachePath() const;
+  // Key of `tag` in the ArtifactStore, unique across sources.
+  std::string storeTag(std::string_view tag) const;
+};
+
+// Reads the sources from kAppDataDir/sources.txt, one per line:
+//
+//   gitlab <label> <releases endpoint URL> [token]
+//   github <label> <owner>/<repo> [token]
+//
+// A GitHub entry may also give the full releases URL (e.g. for GitHub
+// Enterprise). Empty lines and lines starting with '#' are skipped. Returns
+// false when the file does not exist.
+bool loadSources(std::vector<Source>& out);
+
+#endif // SOURCES_H
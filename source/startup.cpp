@@ -0,0 +1,103 @@
+#include <netinet/in.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "cache.h"
+#include "platform.h"
+#include "startup.h"
+
+// -------------------- Startup Profile --------------------
+
+StartupProfile& StartupProfile::get() {
+  static StartupProfile profile;
+  return profile;
+}
+
+StartupProfile::StartupProfile() : begin(armGetSystemTick()) {}
+
+void StartupProfile::mark(const char* phase) {
+  u64 now = armGetSystemTick();
+  std::lock_guard<std::mutex> lock(mtx);
+  if (count < kMaxMarks)
+    marks[count++] = {phase, now};
+}
+
+void StartupProfile::report() {
+#ifdef NRL_STARTUP_PROFILE
+  std::string line = "startup";
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (int i = 0; i < count; ++i) {
+      char field[64];
+      snprintf(field, sizeof(field), " %s_ms=%.1f", marks[i].phase,
+               armTicksToNs(marks[i].tick - begin) / 1e6);
+      line += field;
+    }
+  }
+  line += '\n';
+
+  if (stdoutForwarded()) {
+    fputs(line.c_str(), stdout);
+    fflush(stdout);
+  }
+  ensureAppDataDirectory();
+  std::string path = std::string(kAppDataDir) + "/startup.log";
+  FILE* fp = fopen(path.c_str(), "a");
+  if (!fp) {
+    std::cerr << "Failed to open " << path << "\n";
+    return;
+  }
+  fputs(line.c_str(), fp);
+  fclose(fp);
+#endif
+}
+
+// -------------------- Network Bring-up --------------------
+
+NetworkSession::NetworkSession() {
+  worker = std::thread([this]() { bringUp(); });
+}
+
+NetworkSession::~NetworkSession() {
+  wait();
+  curl.reset();
+  if (nifmUp)
+    nifmExit();
+  if (socketsUp)
+    socketExit();
+}
+
+bool NetworkSession::wait() {
+  if (worker.joinable())
+    worker.join();
+  return socketsUp;
+}
+
+void NetworkSession::bringUp() {
+  StartupProfile& profile = StartupProfile::get();
+  Result rc = socketInitializeDefault();
+  if (R_FAILED(rc)) {
+    std::cerr << "Socket init failed: 0x" << std::hex << rc << std::dec
+              << "\n";
+    return;
+  }
+  socketsUp = true;
+  profile.mark("sockets");
+
+  nifmUp = R_SUCCEEDED(nifmInitialize(NifmServiceType_User));
+  profile.mark("nifm");
+
+  // The loader only passes a host address when nxlink started the app and
+  // is waiting for its output; otherwise the connect would just time out.
+  if (__nxlink_host.s_addr != 0) {
+    if (nxlinkStdio() >= 0)
+      markStdoutForwarded();
+    profile.mark("nxlink");
+  }
+
+  // Sets up the TLS backend as well.
+  curl = std::make_unique<CurlGlobal>();
+  profile.mark("curl");
+}
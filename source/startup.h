@@ -0,0 +1,69 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <switch.h>
+
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "net.h"
+
+// -------------------- Startup Profile --------------------
+
+// When each phase of the launch ended, in system ticks from the first
+// get() at the top of main(). Marks are always taken; builds made with
+// `make STARTUP_PROFILE=1` report them once the browser is up, as one
+// logfmt line in kAppDataDir/startup.log and, when nxlink forwards it, on
+// stdout.
+class StartupProfile {
+public:
+  static StartupProfile& get();
+
+  // Records that `phase`, a string literal, just ended; any thread.
+  void mark(const char* phase);
+  void report();
+
+private:
+  StartupProfile();
+
+  struct Mark {
+    const char* phase;
+    u64 tick;
+  };
+  static const int kMaxMarks = 16;
+
+  std::mutex mtx;
+  u64 begin;
+  Mark marks[kMaxMarks];
+  int count = 0;
+};
+
+// -------------------- Network Bring-up --------------------
+
+// Sockets, nifm, nxlink and curl (with its TLS backend) come up on a
+// worker thread while the UI draws what is cached. Nothing may touch the
+// network before wait() has returned true; it all goes down again, in
+// reverse, when the session is destroyed.
+class NetworkSession {
+public:
+  NetworkSession();
+  ~NetworkSession();
+
+  NetworkSession(const NetworkSession&) = delete;
+  NetworkSession& operator=(const NetworkSession&) = delete;
+
+  // Blocks until the bring-up is done; false when the sockets could not
+  // be initialized.
+  bool wait();
+
+private:
+  void bringUp();
+
+  std::thread worker;
+  bool socketsUp = false;
+  bool nifmUp = false;
+  std::unique_ptr<CurlGlobal> curl;
+};
+
+#endif // STARTUP_H
@@ -0,0 +1,201 @@
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "cache.h"
+#include "download.h"
+#include "store.h"
+
+static const size_t kHashChunk = 256 * 1024;
+
+// -------------------- Hashing --------------------
+
+bool hashFileFrom(const std::string& path, long long offset,
+                  Sha256Context& ctx) {
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+  if (offset > 0 && fseeko(fp, offset, SEEK_SET) != 0) {
+    fclose(fp);
+    return false;
+  }
+  std::unique_ptr<char[]> buf(new char[kHashChunk]);
+  size_t n;
+  while ((n = fread(buf.get(), 1, kHashChunk, fp)) > 0)
+    sha256ContextUpdate(&ctx, buf.get(), n);
+  bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+}
+
+std::string digestHex(Sha256Context& ctx) {
+  uint8_t digest[SHA256_HASH_SIZE];
+  sha256ContextGetHash(&ctx, digest);
+  static const char hex[] = "0123456789abcdef";
+  std::string out;
+  for (uint8_t b : digest) {
+    out += hex[b >> 4];
+    out += hex[b & 15];
+  }
+  return out;
+}
+
+std::string hashFile(const std::string& path) {
+  Sha256Context ctx;
+  sha256ContextCreate(&ctx);
+  if (!hashFileFrom(path, 0, ctx))
+    return {};
+  return digestHex(ctx);
+}
+
+// -------------------- Artifact Store --------------------
+
+static std::string storeDir() {
+  return std::string(kAppDataDir) + "/store";
+}
+
+static std::string indexPath() {
+  return storeDir() + "/store.index";
+}
+
+static void makeDir(const std::string& path) {
+  if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST)
+    std::cerr << "Error creating " << path << ": " << errno << "\n";
+}
+
+static bool fileExists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+ArtifactStore& ArtifactStore::get() {
+  static ArtifactStore store;
+  return store;
+}
+
+std::string ArtifactStore::key(std::string_view tag, std::string_view asset) {
+  std::string k(tag);
+  k += '\t';
+  k += asset;
+  return k;
+}
+
+std::string ArtifactStore::blobPath(const std::string& sha256) const {
+  return storeDir() + "/" + sha256;
+}
+
+// One entry per line: sha256, tag and asset name, tab separated.
+void ArtifactStore::loadLocked() {
+  if (loaded)
+    return;
+  loaded = true;
+  FILE* fp = fopen(indexPath().c_str(), "r");
+  if (!fp)
+    return;
+  char buf[1024];
+  while (fgets(buf, sizeof(buf), fp)) {
+    std::string line(buf);
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+      line.pop_back();
+    size_t tab = line.find('\t');
+    if (tab == std::string::npos || line.find('\t', tab + 1) == std::string::npos)
+      continue;
+    index[line.substr(tab + 1)] = line.substr(0, tab);
+  }
+  fclose(fp);
+}
+
+bool ArtifactStore::saveLocked() {
+  std::string path = indexPath();
+  std::string tmp = path + ".tmp";
+  FILE* fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    std::cerr << "Failed to open " << tmp << "\n";
+    return false;
+  }
+  for (auto& e : index)
+    fprintf(fp, "%s\t%s\n", e.second.c_str(), e.first.c_str());
+  bool ok = fclose(fp) == 0;
+  if (ok) {
+    remove(path.c_str());
+    ok = rename(tmp.c_str(), path.c_str()) == 0;
+  }
+  if (!ok)
+    std::cerr << "Failed to save " << path << "\n";
+  return ok;
+}
+
+std::string ArtifactStore::find(std::string_view tag, std::string_view asset) {
+  std::lock_guard<std::mutex> lock(mtx);
+  loadLocked();
+  auto it = index.find(key(tag, asset));
+  if (it == index.end())
+    return {};
+  std::string path = blobPath(it->second);
+  return fileExists(path) ? path : std::string();
+}
+
+std::string ArtifactStore::incomingPath(std::string_view tag,
+                                        std::string_view asset) {
+  ensureAppDataDirectory();
+  makeDir(storeDir());
+  makeDir(storeDir() + "/incoming");
+  return storeDir() + "/incoming/" + fatSafeName(tag) + "-" +
+         fatSafeName(asset);
+}
+
+std::string ArtifactStore::commit(std::string_view tag, std::string_view asset,
+                                  const std::string& path,
+                                  const std::string& sha256) {
+  if (sha256.empty())
+    return {};
+  std::string blob = blobPath(sha256);
+
+  std::lock_guard<std::mutex> lock(mtx);
+  loadLocked();
+  if (fileExists(blob)) {
+    // Same bytes as something we already have.
+    remove(path.c_str());
+  } else if (rename(path.c_str(), blob.c_str()) != 0) {
+    std::cerr << "Failed to move " << path << " into the store\n";
+    return {};
+  }
+
+  std::string& entry = index[key(tag, asset)];
+  std::string previous = entry;
+  entry = sha256;
+  if (!previous.empty() && previous != sha256) {
+    bool used = false;
+    for (auto& e : index)
+      used = used || e.second == previous;
+    if (!used)
+      remove(blobPath(previous).c_str());
+  }
+  saveLocked();
+  return blob;
+}
+
+bool ArtifactStore::verify(const std::string& path) {
+  size_t slash = path.find_last_of('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  if (hashFile(path) == name)
+    return true;
+  std::cerr << "Stored file " << path << " is damaged; removing it\n";
+  std::lock_guard<std::mutex> lock(mtx);
+  remove(path.c_str());
+  return false;
+}
+
+BlobCheck::BlobCheck(std::string blobPath) : blob(std::move(blobPath)) {
+  worker = std::thread([this]() {
+    ok = ArtifactStore::get().verify(blob);
+    done = true;
+  });
+}
+
+BlobCheck::~BlobCheck() {
+  if (worker.joinable())
+    worker.join();
+}
@@ -0,0 +1,96 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "sha256.h"
+
+// -------------------- Hashing --------------------
+
+// Feeds `path` from byte `offset` to its end into `ctx`.
+bool hashFileFrom(const std::string& path, long long offset,
+                  Sha256Context& ctx);
+
+// Finishes `ctx` and returns the digest as lowercase hex.
+std::string digestHex(Sha256Context& ctx);
+
+// Lowercase hex SHA-256 of a whole file; empty when it cannot be read.
+std::string hashFile(const std::string& path);
+
+// -------------------- Artifact Store --------------------
+
+// Downloaded assets live under kAppDataDir/store, each file named by the
+// SHA-256 of its content, so identical bytes shipped by several releases
+// are kept once. store.index maps (release tag, asset name) to a hash; an
+// asset found there needs no download at all. Blobs no entry refers to any
+// more are deleted. Safe to use from any thread.
+class ArtifactStore {
+public:
+  static ArtifactStore& get();
+
+  ArtifactStore(const ArtifactStore&) = delete;
+  ArtifactStore& operator=(const ArtifactStore&) = delete;
+
+  // Path of the stored file for an asset, or empty when we have none.
+  std::string find(std::string_view tag, std::string_view asset);
+
+  // Where a download of the asset is written until commit(). Stable for a
+  // given asset so interrupted downloads can resume, and named after the
+  // asset rather than its URL, which several assets of a release may share
+  // (e.g. GitLab's .../jobs/<id>/artifacts/download links).
+  std::string incomingPath(std::string_view tag, std::string_view asset);
+
+  // Moves a finished download with the given hash into the store (or drops
+  // it when an identical blob is already there) and points the asset at
+  // it. Returns the blob path, or empty on failure.
+  std::string commit(std::string_view tag, std::string_view asset,
+                     const std::string& path, const std::string& sha256);
+
+  // Re-reads a blob and checks it still matches its name. A damaged blob
+  // is deleted, so its assets get downloaded again.
+  bool verify(const std::string& blobPath);
+
+private:
+  ArtifactStore() = default;
+
+  void loadLocked();
+  bool saveLocked();
+  std::string blobPath(const std::string& sha256) const;
+  static std::string key(std::string_view tag, std::string_view asset);
+
+  std::mutex mtx;
+  bool loaded = false;
+  // key(tag, asset) -> sha256
+  std::unordered_map<std::string, std::string> index;
+};
+
+// Runs ArtifactStore::verify() on its own thread, for callers that must
+// not wait for a large blob to be re-read. Destroying it waits for the
+// check to finish.
+class BlobCheck {
+public:
+  explicit BlobCheck(std::string blobPath);
+  ~BlobCheck();
+
+  BlobCheck(const BlobCheck&) = delete;
+  BlobCheck& operator=(const BlobCheck&) = delete;
+
+  bool isDone() const { return done; }
+  // Whether the blob matched its name; only meaningful once done.
+  bool matches() const { return ok; }
+  const std::string& path() const { return blob; }
+
+private:
+  std::string blob;
+  bool ok = false; // written before `done`
+  std::atomic<bool> done{false};
+  std::thread worker;
+};
+
+#endif // STORE_H
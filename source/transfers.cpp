@@ -0,0 +1,737 @@
+#include <algorithm>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "frames.h"
+#include "platform.h"
+#include "store.h"
+#include "transfers.h"
+
+// How long the loop sleeps with nothing to do; enqueue() and friends wake
+// it up early.
+static const int kIdleWaitMs = 1000;
+static const int kBusyWaitMs = 100;
+
+// A job is only judged slow after this long, and when its average is below
+// 1/kFailoverRatio of the recent rate.
+static const int kFailoverAfterMs = 10000;
+static const curl_off_t kFailoverRatio = 4;
+
+// The URL an item downloads from now.
+static const std::string& currentUrl(const DownloadRequest& req,
+                                     size_t urlIndex) {
+  return urlIndex == 0 ? req.url : req.mirrors[urlIndex - 1];
+}
+
+// Where a delta job downloads its patch.
+static std::string patchPath(const DownloadRequest& req) {
+  return req.outPath + ".bsdiff";
+}
+
+// -------------------- Download Queue --------------------
+
+const char* downloadPriorityName(DownloadPriority p) {
+  switch (p) {
+  case DownloadPriority::Low:
+    return "low";
+  case DownloadPriority::Normal:
+    return "normal";
+  case DownloadPriority::High:
+    return "high";
+  }
+  return "";
+}
+
+const char* downloadStatusName(DownloadStatus s) {
+  switch (s) {
+  case DownloadStatus::Queued:
+    return "queued";
+  case DownloadStatus::Active:
+    return "downloading";
+  case DownloadStatus::Done:
+    return "done";
+  case DownloadStatus::Failed:
+    return "failed";
+  case DownloadStatus::Canceled:
+    return "cancelled";
+  }
+  return "";
+}
+
+const char* downloadVerdictName(DownloadVerdict v) {
+  switch (v) {
+  case DownloadVerdict::Unchecked:
+    return "unchecked";
+  case DownloadVerdict::Verified:
+    return "checksum ok";
+  case DownloadVerdict::Mismatch:
+    return "checksum mismatch";
+  }
+  return "";
+}
+
+// Share of the bandwidth cap a running job gets relative to the others.
+static int priorityWeight(DownloadPriority p) {
+  switch (p) {
+  case DownloadPriority::Low:
+    return 1;
+  case DownloadPriority::Normal:
+    return 2;
+  case DownloadPriority::High:
+    return 4;
+  }
+  return 1;
+}
+
+DownloadManager::DownloadManager() {}
+
+DownloadManager::~DownloadManager() {
+  stopping = true;
+  curl_multi_wakeup(multi.getHandle());
+  if (worker.joinable())
+    worker.join();
+}
+
+void DownloadManager::setActivityListener(
+    std::function<void(bool active)> listener) {
+  activityListener = std::move(listener);
+}
+
+void DownloadManager::start() {
+  worker = std::thread([this]() { run(); });
+}
+
+void DownloadManager::suspend() {
+  suspended = true;
+  curl_multi_wakeup(multi.getHandle());
+}
+
+void DownloadManager::resume() {
+  suspended = false;
+  curl_multi_wakeup(multi.getHandle());
+}
+
+void DownloadManager::restart() {
+  restartRequested = true;
+  curl_multi_wakeup(multi.getHandle());
+}
+
+DownloadManager::Item* DownloadManager::findLocked(int id) const {
+  for (auto& item : items) {
+    if (item->id == id)
+      return item.get();
+  }
+  return nullptr;
+}
+
+int DownloadManager::enqueue(DownloadRequest req) {
+  // Looked up before taking the lock; the store may have to read its index.
+  std::string stored = ArtifactStore::get().find(req.tag, req.asset);
+  int id;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    // Two jobs on one path would share a part file and journal.
+    for (auto& item : items) {
+      if (item->req.outPath == req.outPath &&
+          (item->status == DownloadStatus::Queued ||
+           item->status == DownloadStatus::Active)) {
+        // Asked for by hand while it was being prefetched.
+        if (item->req.background && !req.background) {
+          item->req.background = false;
+          item->req.priority = req.priority;
+          curl_multi_wakeup(multi.getHandle());
+        }
+        return item->id;
+      }
+    }
+    auto item = std::make_unique<Item>();
+    item->id = id = nextId++;
+    item->seq = nextSeq++;
+    item->req = std::move(req);
+    if (!stored.empty()) {
+      struct stat st;
+      curl_off_t size = stat(stored.c_str(), &st) == 0 ? st.st_size : 0;
+      item->status = DownloadStatus::Done;
+      item->path = stored;
+      item->total = size;
+      item->now = size;
+    }
+    items.push_back(std::move(item));
+  }
+  curl_multi_wakeup(multi.getHandle());
+  return id;
+}
+
+void DownloadManager::cancel(int id) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    Item* item = findLocked(id);
+    if (!item)
+      return;
+    if (item->status == DownloadStatus::Queued)
+      item->status = DownloadStatus::Canceled;
+    else if (item->status == DownloadStatus::Active)
+      item->canceled = true; // the job notices in its progress callback
+    item->preempted = false;
+    item->switching = false;
+  }
+  curl_multi_wakeup(multi.getHandle());
+}
+
+void DownloadManager::retry(int id) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    Item* item = findLocked(id);
+    if (!item || (item->status != DownloadStatus::Failed &&
+                  item->status != DownloadStatus::Canceled))
+      return;
+    item->status = DownloadStatus::Queued;
+    item->seq = nextSeq++;
+    item->canceled = false;
+    item->urlIndex = 0;
+    item->verdict = DownloadVerdict::Unchecked;
+    item->total = 0;
+    item->now = 0;
+  }
+  curl_multi_wakeup(multi.getHandle());
+}
+
+void DownloadManager::setPriority(int id, DownloadPriority priority) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    Item* item = findLocked(id);
+    if (item)
+      item->req.priority = priority;
+  }
+  curl_multi_wakeup(multi.getHandle());
+}
+
+void DownloadManager::clearFinished() {
+  std::lock_guard<std::mutex> lock(mtx);
+  items.erase(std::remove_if(items.begin(), items.end(),
+                             [](const std::unique_ptr<Item>& item) {
+                               return item->status != DownloadStatus::Queued &&
+                                      item->status != DownloadStatus::Active;
+                             }),
+              items.end());
+}
+
+void DownloadManager::setMaxActive(int n) {
+  maxJobs = n < 1 ? 1 : n;
+  curl_multi_wakeup(multi.getHandle());
+}
+
+void DownloadManager::setBandwidthCap(curl_off_t bytesPerSecond) {
+  cap = bytesPerSecond < 0 ? 0 : bytesPerSecond;
+  curl_multi_wakeup(multi.getHandle());
+}
+
+std::vector<DownloadInfo> DownloadManager::list() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  std::vector<DownloadInfo> out;
+  out.reserve(items.size());
+  for (auto& item : items) {
+    DownloadInfo info;
+    info.id = item->id;
+    info.name = item->req.name;
+    info.priority = item->req.priority;
+    info.status = item->status;
+    info.total = item->total;
+    info.now = item->now;
+    info.resumable = item->resumable;
+    info.path = item->path;
+    info.background = item->req.background;
+    info.verdict = item->verdict;
+    info.stats = item->stats;
+    out.push_back(std::move(info));
+  }
+  return out;
+}
+
+// -------------------- Network Thread --------------------
+
+void DownloadManager::run() {
+  pinCurrentThreadToCore(kNetworkCore);
+  CURLM* handle = multi.getHandle();
+  bool wasActive = false;
+  size_t lastJobs = 0;
+
+  for (;;) {
+    if (stopping) {
+      // Let running jobs wind down on their own so they save journals.
+      for (Item* item : running)
+        item->canceled = true;
+      for (Item* item : patching)
+        item->canceled = true;
+      reapPatched();
+      if (running.empty() && patching.empty())
+        break;
+    } else if (suspended) {
+      suspendRunning();
+    } else {
+      // The stopped jobs are re-queued by reapFinished() as they end.
+      if (restartRequested.exchange(false))
+        suspendRunning();
+      preemptBackground();
+      startQueued();
+    }
+    balanceBandwidth();
+
+    int active = 0;
+    curl_multi_perform(handle, &active);
+    while (CURLMsg* msg = multi.nextDone()) {
+      if (checksumDone(msg->easy_handle, msg->data.result))
+        continue;
+      for (Item* item : running) {
+        if (item->job->handleDone(handle, msg->easy_handle, msg->data.result))
+          break;
+      }
+    }
+    for (Item* item : running)
+      item->job->resumePaused(handle);
+    sampleStats();
+    reapFinished();
+    reapPatched();
+
+    bool busy = !running.empty() || !patching.empty();
+    if (busy != wasActive && activityListener)
+      activityListener(busy);
+    wasActive = busy;
+    // Something started or finished; an idle browser redraws the queue.
+    size_t jobs = running.size() + patching.size();
+    if (jobs != lastJobs)
+      FrameScheduler::get().notify();
+    lastJobs = jobs;
+
+    // Returns early on socket activity or curl_multi_wakeup().
+    curl_multi_poll(handle, nullptr, 0,
+                    running.empty() && patching.empty() ? kIdleWaitMs
+                                                        : kBusyWaitMs,
+                    nullptr);
+  }
+}
+
+bool DownloadManager::foregroundPendingLocked() const {
+  for (auto& item : items) {
+    if (!item->req.background && (item->status == DownloadStatus::Queued ||
+                                  item->status == DownloadStatus::Active))
+      return true;
+  }
+  return false;
+}
+
+void DownloadManager::preemptBackground() {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (!foregroundPendingLocked())
+    return;
+  for (Item* item : running) {
+    if (item->req.background && !item->preempted) {
+      item->preempted = true;
+      item->canceled = true;
+    }
+  }
+}
+
+void DownloadManager::suspendRunning() {
+  std::lock_guard<std::mutex> lock(mtx);
+  for (Item* item : running) {
+    // Handled by reapFinished() like a preempted background job.
+    if (!item->preempted && !item->canceled) {
+      item->preempted = true;
+      item->canceled = true;
+    }
+  }
+}
+
+void DownloadManager::startQueued() {
+  std::lock_guard<std::mutex> lock(mtx);
+  bool foreground = foregroundPendingLocked();
+  while ((int)running.size() < maxJobs) {
+    Item* next = nullptr;
+    for (auto& item : items) {
+      if (item->status != DownloadStatus::Queued ||
+          (foreground && item->req.background))
+        continue;
+      if (!next || item->req.priority > next->req.priority ||
+          (item->req.priority == next->req.priority && item->seq < next->seq))
+        next = item.get();
+    }
+    if (!next)
+      return;
+
+    next->status = DownloadStatus::Active;
+    next->resumable = false;
+    next->appliedRate = 0;
+    next->stats = TransferStats();
+    next->meter.start();
+    next->diskAtStart = DiskPipeline::get().writeLatency().snapshot();
+    DownloadCallbackData cb{&next->canceled, &next->total, &next->now};
+    bool delta = !next->req.delta.empty();
+    const std::string& url = currentUrl(next->req, next->urlIndex);
+    // A mirror on another host must not see the token.
+    std::string token = delta || urlHost(url) == urlHost(next->req.url)
+                            ? next->req.token
+                            : std::string();
+    next->job = std::make_unique<DownloadJob>(
+        delta ? next->req.delta.patchUrl : url, token,
+        delta ? patchPath(next->req) : next->req.outPath, cb);
+    if (!next->req.extract.empty())
+      next->job->extractTo(next->req.extract);
+    next->job->start(multi.getHandle());
+    // A delta's result is checked by the patcher.
+    if (!delta && !next->req.checksumUrl.empty() && !next->sumsFetched)
+      startChecksumFetch(next);
+    running.push_back(next);
+  }
+}
+
+void DownloadManager::reapFinished() {
+  for (size_t i = 0; i < running.size();) {
+    Item* item = running[i];
+    if (!item->job->isFinished()) {
+      ++i;
+      continue;
+    }
+    // The list is small and usually in long before the file.
+    if (item->sums && item->job->succeeded()) {
+      ++i;
+      continue;
+    }
+    dropChecksumFetch(item);
+    bool ok = item->job->succeeded();
+    bool resumable = item->job->canResume();
+    publishStats(item, item->stats);
+    if (ok && item->appliedRate == 0 && item->stats.avgRate > 0) {
+      recentRate = recentRate == 0
+                       ? item->stats.avgRate
+                       : (recentRate * 3 + item->stats.avgRate) / 4;
+    }
+    bool preempted, failover;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      preempted = item->preempted && !ok;
+      // Too slow (see sampleStats()), or failed with a mirror left to try.
+      failover = !ok && !preempted && item->req.delta.empty() &&
+                 item->urlIndex < item->req.mirrors.size() &&
+                 (item->switching || !item->canceled);
+      item->preempted = false;
+      item->switching = false;
+      if (failover) {
+        ++item->urlIndex;
+        item->total = 0;
+        item->now = 0;
+      }
+      if (preempted || failover) {
+        // Back in line; the next run resumes from the journal.
+        item->canceled = false;
+        item->resumable = resumable;
+        item->status = DownloadStatus::Queued;
+      }
+    }
+    if (preempted || failover) {
+      TransferLog::get().record(item->req.name,
+                                preempted ? "paused" : "failover", item->now,
+                                item->stats);
+      if (failover)
+        std::cerr << item->req.name << ": trying "
+                  << currentUrl(item->req, item->urlIndex) << "\n";
+      item->job.reset();
+      running.erase(running.begin() + i);
+      continue;
+    }
+    DownloadStatus outcome = ok               ? DownloadStatus::Done
+                             : item->canceled ? DownloadStatus::Canceled
+                                              : DownloadStatus::Failed;
+    TransferLog::get().record(item->req.name, downloadStatusName(outcome),
+                              item->now, item->stats);
+    if (!item->req.delta.empty()) {
+      item->job.reset();
+      running.erase(running.begin() + i);
+      if (ok) {
+        startPatch(item);
+      } else if (item->canceled) {
+        std::lock_guard<std::mutex> lock(mtx);
+        item->resumable = resumable;
+        item->status = DownloadStatus::Canceled;
+      } else {
+        fallBackToFull(item);
+      }
+      continue;
+    }
+    // req is only written under the lock by setPriority(), which leaves
+    // the asset fields alone.
+    std::string stored;
+    if (ok && !item->req.extract.empty())
+      stored = commitExtracted(*item);
+    else if (ok && verifyDownload(item))
+      stored = ArtifactStore::get().commit(item->req.tag, item->req.asset,
+                                           item->req.outPath,
+                                           item->job->sha256());
+    ok = ok && !stored.empty();
+    item->job.reset();
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      item->resumable = resumable;
+      item->path = stored;
+      if (ok)
+        item->status = DownloadStatus::Done;
+      else if (item->canceled)
+        item->status = DownloadStatus::Canceled;
+      else
+        item->status = DownloadStatus::Failed;
+    }
+    running.erase(running.begin() + i);
+  }
+}
+
+std::string DownloadManager::commitExtracted(const Item& item) {
+  ArtifactStore& store = ArtifactStore::get();
+  const std::vector<ZipExtractor::File>& files = item.job->extractedFiles();
+  std::string first;
+  for (auto& f : files) {
+    std::string blob = store.commit(item.req.tag,
+                                    item.req.asset + "/" + f.name, f.path,
+                                    f.sha256);
+    if (first.empty() && !blob.empty()) {
+      // Already in the store by now, so this only adds the index entry.
+      store.commit(item.req.tag, item.req.asset, f.path, f.sha256);
+      first = blob;
+    }
+  }
+  if (files.empty())
+    std::cerr << item.req.name << ": no matching files in the archive\n";
+  return first;
+}
+
+// -------------------- Verification --------------------
+
+void DownloadManager::startChecksumFetch(Item* item) {
+  item->sums = std::make_unique<ChecksumFetch>();
+  ChecksumFetch& f = *item->sums;
+  if (!item->req.token.empty())
+    f.headers = curl_slist_append(
+        f.headers, ("PRIVATE-TOKEN: " + item->req.token).c_str());
+  f.curl.setopt(CURLOPT_FAILONERROR, 1L);
+  f.curl.acceptCompressed();
+  curl_easy_setopt(f.curl.getHandle(), CURLOPT_WRITEFUNCTION,
+                   MemoryBuffer::WriteCallback);
+  curl_easy_setopt(f.curl.getHandle(), CURLOPT_WRITEDATA, &f.body);
+  requestChecksums(item, item->req.checksumUrl);
+}
+
+void DownloadManager::requestChecksums(Item* item, const std::string& url) {
+  ChecksumFetch& f = *item->sums;
+  f.curl.setopt(CURLOPT_URL, url.c_str());
+  f.curl.setopt(CURLOPT_HTTPHEADER,
+                urlHost(url) == urlHost(item->req.checksumUrl) ? f.headers
+                                                               : nullptr);
+  f.body.data.clear();
+  curl_multi_add_handle(multi.getHandle(), f.curl.getHandle());
+}
+
+bool DownloadManager::checksumDone(CURL* easy, CURLcode res) {
+  for (Item* item : running) {
+    if (!item->sums || item->sums->curl.getHandle() != easy)
+      continue;
+    curl_multi_remove_handle(multi.getHandle(), easy);
+    std::string next = res == CURLE_OK ? redirectTarget(easy) : std::string();
+    if (!next.empty()) {
+      if (item->sums->redirects++ < kMaxRedirects) {
+        requestChecksums(item, next);
+        return true;
+      }
+      res = CURLE_TOO_MANY_REDIRECTS;
+    }
+    if (res == CURLE_OK) {
+      item->expectedSha256 =
+          findChecksum(item->sums->body.data, item->req.checksumName);
+      if (item->expectedSha256.empty())
+        std::cerr << item->req.name << ": " << item->req.checksumName
+                  << " is not in its checksum list\n";
+    } else {
+      std::cerr << item->req.name << ": checksum list failed: "
+                << curl_easy_strerror(res) << "\n";
+    }
+    // A failed fetch is tried again with the next run of the job.
+    item->sumsFetched = res == CURLE_OK;
+    item->sums.reset();
+    return true;
+  }
+  return false;
+}
+
+void DownloadManager::dropChecksumFetch(Item* item) {
+  if (!item->sums)
+    return;
+  curl_multi_remove_handle(multi.getHandle(), item->sums->curl.getHandle());
+  item->sums.reset();
+}
+
+bool DownloadManager::verifyDownload(Item* item) {
+  DownloadVerdict verdict = DownloadVerdict::Unchecked;
+  const std::string& got = item->job->sha256();
+  if (!item->expectedSha256.empty())
+    verdict = got == item->expectedSha256 ? DownloadVerdict::Verified
+                                          : DownloadVerdict::Mismatch;
+  if (verdict == DownloadVerdict::Mismatch) {
+    std::cerr << item->req.name << ": SHA-256 " << got
+              << " does not match the published " << item->expectedSha256
+              << "\n";
+    remove(item->req.outPath.c_str());
+  }
+  std::lock_guard<std::mutex> lock(mtx);
+  item->verdict = verdict;
+  return verdict != DownloadVerdict::Mismatch;
+}
+
+// -------------------- Statistics --------------------
+
+void DownloadManager::sampleStats() {
+  for (Item* item : running) {
+    // Only this thread writes stats, so reading them needs no lock.
+    TransferStats s = item->stats;
+    if (!item->meter.sample(item->now, item->job->waitingOnDisk(), s))
+      continue;
+    publishStats(item, s);
+    if (tooSlow(item, s)) {
+      std::lock_guard<std::mutex> lock(mtx);
+      // Unless the user cancelled it meanwhile.
+      if (!item->switching && !item->canceled) {
+        item->switching = true;
+        item->canceled = true;
+      }
+    }
+  }
+}
+
+bool DownloadManager::tooSlow(const Item* item,
+                              const TransferStats& s) const {
+  // A capped job or one held up by the disk says nothing about the server.
+  if (cap > 0 || item->job->waitingOnDisk())
+    return false;
+  if (!item->req.delta.empty() ||
+      item->urlIndex >= item->req.mirrors.size())
+    return false;
+  return recentRate > 0 && s.elapsedMs >= kFailoverAfterMs &&
+         s.avgRate * kFailoverRatio < recentRate;
+}
+
+void DownloadManager::publishStats(Item* item, TransferStats s) {
+  s.phases = item->job->phaseTimes();
+  s.diskWaits = item->job->diskWaits();
+  s.diskWrites =
+      DiskPipeline::get().writeLatency().snapshot().since(item->diskAtStart);
+  std::lock_guard<std::mutex> lock(mtx);
+  item->stats = s;
+}
+
+// -------------------- Delta Patching --------------------
+
+void DownloadManager::startPatch(Item* item) {
+  item->patched = false;
+  item->patchedSha256.clear();
+  patching.push_back(item);
+  // The request does not change while the item is Active (see
+  // reapFinished()), so the thread reads it without the lock.
+  item->patcher = std::thread([this, item]() {
+    const DeltaPlan& plan = item->req.delta;
+    std::string list;
+    std::string want;
+    if (fetchText(plan.checksumUrl, item->req.token, list))
+      want = findChecksum(list, plan.checksumName);
+    if (want.empty()) {
+      std::cerr << item->req.name << ": no published checksum for "
+                << plan.checksumName << "\n";
+    } else {
+      std::string got = applyBsdiff(plan.basePath, patchPath(item->req),
+                                    item->req.outPath, item->canceled,
+                                    item->now, item->total);
+      if (!got.empty() && got != want) {
+        std::cerr << item->req.name << ": patched file does not match its "
+                  << "checksum\n";
+        remove(item->req.outPath.c_str());
+      } else if (got == want) {
+        item->patchedSha256 = got;
+      }
+    }
+    item->patched = true;
+    curl_multi_wakeup(multi.getHandle());
+  });
+}
+
+void DownloadManager::reapPatched() {
+  for (size_t i = 0; i < patching.size();) {
+    Item* item = patching[i];
+    if (!item->patched) {
+      ++i;
+      continue;
+    }
+    item->patcher.join();
+    remove(patchPath(item->req).c_str());
+    std::string stored;
+    if (!item->patchedSha256.empty())
+      stored = ArtifactStore::get().commit(item->req.tag, item->req.asset,
+                                           item->req.outPath,
+                                           item->patchedSha256);
+    patching.erase(patching.begin() + i);
+
+    if (stored.empty() && !item->canceled) {
+      fallBackToFull(item);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    item->resumable = false;
+    item->path = stored;
+    // Only a result matching the published checksum is stored.
+    if (!stored.empty())
+      item->verdict = DownloadVerdict::Verified;
+    item->status =
+        stored.empty() ? DownloadStatus::Canceled : DownloadStatus::Done;
+  }
+}
+
+void DownloadManager::fallBackToFull(Item* item) {
+  std::cerr << item->req.name << ": delta update failed, downloading the "
+            << "full file\n";
+  // A partial patch is of no use once we stop trying it.
+  std::string patch = patchPath(item->req);
+  for (const char* suffix : {"", ".part", ".part.journal"})
+    remove((patch + suffix).c_str());
+  std::lock_guard<std::mutex> lock(mtx);
+  item->req.delta = DeltaPlan();
+  item->status = DownloadStatus::Queued;
+  item->resumable = false;
+  item->total = 0;
+  item->now = 0;
+}
+
+void DownloadManager::balanceBandwidth() {
+  if (running.empty())
+    return;
+
+  std::vector<int> weights;
+  int sum = 0;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (Item* item : running) {
+      weights.push_back(priorityWeight(item->req.priority));
+      sum += weights.back();
+    }
+  }
+
+  // CURLOPT_MAX_RECV_SPEED_LARGE is per connection, so a job's share is
+  // split again between its segments.
+  curl_off_t total = cap;
+  for (size_t i = 0; i < running.size(); ++i) {
+    Item* item = running[i];
+    curl_off_t rate = 0;
+    if (total > 0) {
+      int conns = std::max(1, item->job->connectionCount());
+      rate = std::max<curl_off_t>(1, total * weights[i] / sum / conns);
+    }
+    if (rate != item->appliedRate) {
+      item->job->setMaxRecvSpeed(rate);
+      item->appliedRate = rate;
+    }
+  }
+}
@@ -0,0 +1,250 @@
+#ifndef TRANSFERS_H
+#define TRANSFERS_H
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delta.h"
+#include "download.h"
+#include "metrics.h"
+#include "net.h"
+
+// -------------------- Download Queue --------------------
+//
+// Background download manager. Requests are queued from the UI thread and
+// run on one curl_multi loop on the network core: up to maxActive() jobs at
+// a time, highest priority first (FIFO within a priority). A global
+// bandwidth cap is shared between the running jobs in proportion to their
+// priority. Every transfer is measured (see metrics.h) and logged once it
+// ends. Finished files are handed to the ArtifactStore. Delta patches
+// are applied on a thread of their own so the loop keeps transferring.
+//
+// A job that fails, or that crawls far below the rate recent downloads
+// reached, moves on to the request's next mirror and resumes there when
+// the file's validator allows it.
+//
+// A file with a published checksum is checked against it before it is
+// stored. The list is fetched on the same loop while the file downloads,
+// and the file's SHA-256 is taken from the stream (see DownloadJob), so
+// the verdict is there when the transfer ends.
+
+enum class DownloadPriority { Low, Normal, High };
+
+enum class DownloadStatus { Queued, Active, Done, Failed, Canceled };
+
+// What the published checksum said about the file.
+enum class DownloadVerdict { Unchecked, Verified, Mismatch };
+
+struct DownloadRequest {
+  std::string name;
+  std::string url; // already passed through resolveArtifactUrl()
+  // Other locations of the same file, tried in order once `url` fails or
+  // is too slow. The token is only sent to the host of `url`.
+  std::vector<std::string> mirrors;
+  std::string token;
+  // Identify the asset in the ArtifactStore.
+  std::string tag;
+  std::string asset;
+  // Where the bytes go until the store takes them over.
+  std::string outPath;
+  // When set the asset is a zip archive: only its entries ending in one of
+  // these are kept (unpacked while downloading), each stored as
+  // "<asset>/<entry>", and the asset itself stands for the first of them.
+  std::vector<std::string> extract;
+  // sha256sum-format list holding the file's hash (see findChecksum()),
+  // and the name it is listed under. A file that does not match fails; one
+  // without a list, or not in it, is stored unchecked.
+  std::string checksumUrl;
+  std::string checksumName;
+  // When set, the patch is downloaded instead and applied to the older
+  // release's copy; any failure falls back to the full download.
+  DeltaPlan delta;
+  DownloadPriority priority = DownloadPriority::Normal;
+  // A prefetch nobody asked for yet: it only runs while no other entry is
+  // queued or running, and steps back into the queue (keeping its partial
+  // file) as soon as one is. Queuing the same file by hand makes it an
+  // ordinary entry.
+  bool background = false;
+};
+
+// Copy of one queue entry for display.
+struct DownloadInfo {
+  int id = 0;
+  std::string name;
+  DownloadPriority priority = DownloadPriority::Normal;
+  DownloadStatus status = DownloadStatus::Queued;
+  curl_off_t total = 0;
+  curl_off_t now = 0;
+  bool resumable = false;
+  std::string path; // the stored file, once Done
+  bool background = false;
+  DownloadVerdict verdict = DownloadVerdict::Unchecked;
+  TransferStats stats; // of the current or last transfer
+
+  bool operator==(const DownloadInfo& o) const {
+    return id == o.id && name == o.name && priority == o.priority &&
+           status == o.status && total == o.total && now == o.now &&
+           resumable == o.resumable && path == o.path &&
+           background == o.background && verdict == o.verdict &&
+           stats == o.stats;
+  }
+  bool operator!=(const DownloadInfo& o) const { return !(*this == o); }
+};
+
+class DownloadManager {
+public:
+  DownloadManager();
+  // Cancels running jobs (they keep their partial files when resumable)
+  // and stops the network thread.
+  ~DownloadManager();
+
+  DownloadManager(const DownloadManager&) = delete;
+  DownloadManager& operator=(const DownloadManager&) = delete;
+
+  // Called on the network thread whenever jobs start running with none
+  // before, or the last one ends. Set before start().
+  void setActivityListener(std::function<void(bool active)> listener);
+
+  void start();
+
+  // Stops the running jobs, keeping their partial files, and starts none
+  // until resume(); they go back to the queue in their old places. For
+  // when the app is about to be frozen or its connections are gone.
+  void suspend();
+  void resume();
+  // Stops the running jobs once, the way suspend() does, and lets them
+  // start again right away, on new connections.
+  void restart();
+
+  // Returns the id of the new entry, or of the queued/running entry that
+  // already writes to the same file. An asset the ArtifactStore already
+  // holds is entered as Done straight away.
+  int enqueue(DownloadRequest req);
+  void cancel(int id);
+  // Puts a failed or cancelled entry back in the queue.
+  void retry(int id);
+  void setPriority(int id, DownloadPriority priority);
+  // Drops finished, failed and cancelled entries.
+  void clearFinished();
+
+  void setMaxActive(int n);
+  int maxActive() const { return maxJobs; }
+  // Bytes per second over all jobs; 0 means unlimited.
+  void setBandwidthCap(curl_off_t bytesPerSecond);
+  curl_off_t bandwidthCap() const { return cap; }
+
+  std::vector<DownloadInfo> list() const;
+
+private:
+  // A request's checksum list, downloading next to the file.
+  struct ChecksumFetch {
+    ChecksumFetch() = default;
+    ChecksumFetch(const ChecksumFetch&) = delete;
+    ChecksumFetch& operator=(const ChecksumFetch&) = delete;
+    ~ChecksumFetch() { curl_slist_free_all(headers); }
+
+    CurlEasy curl;
+    MemoryBuffer body;
+    struct curl_slist* headers = nullptr;
+    int redirects = 0;
+  };
+
+  struct Item {
+    int id = 0;
+    unsigned long seq = 0;
+    DownloadRequest req;
+    DownloadStatus status = DownloadStatus::Queued;
+    bool resumable = false;
+    std::string path;
+    std::atomic<bool> canceled{false};
+    std::atomic<curl_off_t> total{0};
+    std::atomic<curl_off_t> now{0};
+    // Owned by the network thread while the item is Active.
+    std::unique_ptr<DownloadJob> job;
+    curl_off_t appliedRate = 0;
+    // A background job stopped to make way; it goes back to Queued.
+    bool preempted = false;
+    // 0 for req.url, else the mirror before it.
+    size_t urlIndex = 0;
+    // Stopped for being slow; it goes back to Queued on the next mirror.
+    bool switching = false;
+    // Written by the network thread, under the lock.
+    TransferStats stats;
+    RateMeter meter;
+    LatencyHistogram::Counts diskAtStart;
+    // Applying a downloaded delta; the item stays Active meanwhile.
+    std::thread patcher;
+    std::atomic<bool> patched{false};
+    std::string patchedSha256; // written by patcher before `patched`
+    // Network thread only, apart from `verdict` (under the lock).
+    std::unique_ptr<ChecksumFetch> sums;
+    bool sumsFetched = false;
+    std::string expectedSha256; // empty when none was published
+    DownloadVerdict verdict = DownloadVerdict::Unchecked;
+  };
+
+  void run();
+  void startQueued();
+  // Stops background jobs while anything else wants the network.
+  void preemptBackground();
+  // Stops every running job the way preemptBackground() does.
+  void suspendRunning();
+  bool foregroundPendingLocked() const;
+  void reapFinished();
+  void balanceBandwidth();
+  void sampleStats();
+  // Whether a job this slow should give way to the next mirror.
+  bool tooSlow(const Item* item, const TransferStats& s) const;
+  // Copies the job's own counters into item->stats.
+  void publishStats(Item* item, TransferStats s);
+  void startChecksumFetch(Item* item);
+  // Points the fetch at `url`, with the token only on the list's own host.
+  void requestChecksums(Item* item, const std::string& url);
+  // Returns true when `easy` was an item's checksum list.
+  bool checksumDone(CURL* easy, CURLcode res);
+  void dropChecksumFetch(Item* item);
+  // Compares a finished download with its published checksum; false when
+  // they differ.
+  bool verifyDownload(Item* item);
+  void startPatch(Item* item);
+  void reapPatched();
+  // Re-queues a delta item as a plain download of the full asset.
+  void fallBackToFull(Item* item);
+  // Stores the files an extracting job unpacked; returns the first one.
+  std::string commitExtracted(const Item& item);
+  Item* findLocked(int id) const;
+
+  CurlMulti multi;
+
+  mutable std::mutex mtx;
+  std::vector<std::unique_ptr<Item>> items;
+  int nextId = 1;
+  unsigned long nextSeq = 0;
+
+  // Network thread only.
+  std::vector<Item*> running;
+  std::vector<Item*> patching;
+  // Moving average of what uncapped downloads reached this session.
+  curl_off_t recentRate = 0;
+
+  std::atomic<int> maxJobs{2};
+  std::atomic<curl_off_t> cap{0};
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> suspended{false};
+  std::atomic<bool> restartRequested{false};
+  std::function<void(bool active)> activityListener;
+  std::thread worker;
+};
+
+const char* downloadPriorityName(DownloadPriority p);
+const char* downloadStatusName(DownloadStatus s);
+const char* downloadVerdictName(DownloadVerdict v);
+
+#endif // TRANSFERS_H
@@ -0,0 +1,417 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <strings.h>
+#include <thread>
+#include <unistd.h>
+
+#include "download.h"
+#include "store.h"
+#include "unzip.h"
+
+static const uint32_t kLocalHeaderSig = 0x04034b50;
+static const uint32_t kDescriptorSig = 0x08074b50;
+static const uint32_t kCentralHeaderSig = 0x02014b50;
+static const uint32_t kEndOfCentralSig = 0x06054b50;
+static const size_t kLocalHeaderSize = 30;
+static const uint16_t kFlagDescriptor = 0x0008;
+static const uint16_t kMethodStored = 0;
+static const uint16_t kMethodDeflated = 8;
+
+// Inflated bytes are staged here before going to the writer.
+static const size_t kOutputSize = 64 * 1024;
+
+static uint16_t le16(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return u[0] | u[1] << 8;
+}
+
+static uint32_t le32(const char* p) {
+  return le16(p) | (uint32_t)le16(p + 2) << 16;
+}
+
+static uint64_t le64(const char* p) {
+  return le32(p) | (uint64_t)le32(p + 4) << 32;
+}
+
+// -------------------- Streaming Zip Extraction --------------------
+
+ZipExtractor::ZipExtractor(std::string pathPrefix,
+                           std::vector<std::string> suffixes)
+    : prefix(std::move(pathPrefix)), suffixes(std::move(suffixes)),
+      out(new char[kOutputSize]) {
+  memset(&zs, 0, sizeof(zs));
+}
+
+ZipExtractor::~ZipExtractor() {
+  if (inflating)
+    inflateEnd(&zs);
+  if (writer)
+    writer->close();
+}
+
+void ZipExtractor::fail(const char* why) {
+  if (state != State::Failed)
+    std::cerr << "Zip extraction failed: " << why << "\n";
+  state = State::Failed;
+}
+
+WriteResult ZipExtractor::write(const char* data, size_t n) {
+  if (state == State::Failed)
+    return WriteResult::Error;
+  if (blocked) {
+    if (!flush())
+      return WriteResult::Full;
+    blocked = false;
+    // Catch up on what was left over before taking anything new.
+    process();
+    if (state == State::Failed)
+      return WriteResult::Error;
+    if (blocked)
+      return WriteResult::Full;
+  }
+  input.append(data, n);
+  process();
+  return state == State::Failed ? WriteResult::Error : WriteResult::Ok;
+}
+
+void ZipExtractor::process() {
+  while (!blocked && state != State::Failed) {
+    size_t avail = input.size() - pos;
+    const char* p = input.data() + pos;
+    bool progressed = true;
+
+    switch (state) {
+    case State::Signature: {
+      if (avail < 4) {
+        progressed = false;
+        break;
+      }
+      uint32_t sig = le32(p);
+      if (sig == kLocalHeaderSig)
+        state = State::Header;
+      else if (sig == kCentralHeaderSig || sig == kEndOfCentralSig)
+        state = State::Trailer;
+      else
+        fail("not a zip archive");
+      break;
+    }
+    case State::Header: {
+      if (avail < kLocalHeaderSize) {
+        progressed = false;
+        break;
+      }
+      size_t nameLen = le16(p + 26);
+      size_t extraLen = le16(p + 28);
+      if (avail < kLocalHeaderSize + nameLen + extraLen) {
+        progressed = false;
+        break;
+      }
+      pos += kLocalHeaderSize + nameLen + extraLen;
+      if (beginEntry(p, nameLen, extraLen))
+        state = State::Data;
+      break;
+    }
+    case State::Data: {
+      bool done = method == kMethodDeflated ? takeDeflated(avail)
+                                            : takeStored(avail);
+      if (!done) {
+        progressed = false;
+        break;
+      }
+      state = flags & kFlagDescriptor ? State::Descriptor : State::Closing;
+      break;
+    }
+    case State::Descriptor: {
+      // The signature is optional; sizes are 8 bytes each in zip64 form.
+      if (avail < 4) {
+        progressed = false;
+        break;
+      }
+      size_t skip = le32(p) == kDescriptorSig ? 4 : 0;
+      size_t need = skip + (zip64 ? 20 : 12);
+      if (avail < need) {
+        progressed = false;
+        break;
+      }
+      crc = le32(p + skip);
+      size = zip64 ? le64(p + skip + 12) : le32(p + skip + 8);
+      pos += need;
+      state = State::Closing;
+      break;
+    }
+    case State::Closing:
+      if (closeEntry())
+        state = State::Signature;
+      else
+        progressed = false;
+      break;
+    case State::Trailer:
+      // The central directory repeats what we have already seen.
+      pos = input.size();
+      progressed = false;
+      break;
+    case State::Failed:
+      progressed = false;
+      break;
+    }
+    if (!progressed)
+      break;
+  }
+
+  input.erase(0, pos);
+  pos = 0;
+}
+
+bool ZipExtractor::isWritten(const std::string& p) const {
+  for (auto& f : written) {
+    if (f.path == p)
+      return true;
+  }
+  return false;
+}
+
+bool ZipExtractor::beginEntry(const char* h, size_t nameLen, size_t extraLen) {
+  flags = le16(h + 6);
+  method = le16(h + 8);
+  crc = le32(h + 14);
+  compressedSize = le32(h + 18);
+  size = le32(h + 22);
+  name.assign(h + kLocalHeaderSize, nameLen);
+  consumed = 0;
+  produced = 0;
+
+  // Zip64 extra field: the 64-bit sizes, present for the fields whose
+  // 32-bit value is saturated.
+  zip64 = false;
+  const char* x = h + kLocalHeaderSize + nameLen;
+  for (size_t i = 0; i + 4 <= extraLen;) {
+    uint16_t id = le16(x + i);
+    uint16_t len = le16(x + i + 2);
+    if (id == 0x0001) {
+      zip64 = true;
+      size_t f = i + 4;
+      if (size == 0xFFFFFFFF && f + 8 <= i + 4 + len) {
+        size = le64(x + f);
+        f += 8;
+      }
+      if (compressedSize == 0xFFFFFFFF && f + 8 <= i + 4 + len)
+        compressedSize = le64(x + f);
+    }
+    i += 4 + len;
+  }
+
+  bool sized = !(flags & kFlagDescriptor);
+  bool isDir = !name.empty() && name.back() == '/';
+  wanted = !isDir && suffixes.empty();
+  for (auto& s : suffixes) {
+    wanted = wanted || (!isDir && name.size() >= s.size() &&
+                        strcasecmp(name.c_str() + name.size() - s.size(),
+                                   s.c_str()) == 0);
+  }
+
+  if (method != kMethodStored && method != kMethodDeflated) {
+    if (wanted || !sized) {
+      fail("unsupported compression method");
+      return false;
+    }
+    // Skipped unread, like a stored entry.
+    method = kMethodStored;
+  }
+  if (method == kMethodStored && !sized) {
+    fail("stored entry without sizes");
+    return false;
+  }
+  if (method == kMethodDeflated) {
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+      fail("inflateInit2");
+      return false;
+    }
+    inflating = true;
+  }
+  if (!wanted)
+    return true;
+
+  size_t slash = name.find_last_of('/');
+  path = prefix + fatSafeName(slash == std::string::npos
+                                  ? name
+                                  : std::string_view(name).substr(slash + 1));
+  // Same name in another directory: foo.nro, foo-2.nro, ...
+  std::string base = path;
+  size_t dot = base.find_last_of('.');
+  if (dot == std::string::npos || dot <= prefix.size())
+    dot = base.size();
+  for (int n = 2; isWritten(path); ++n)
+    path = base.substr(0, dot) + "-" + std::to_string(n) + base.substr(dot);
+
+  // AlignedWriter writes into an existing file.
+  FILE* fp = fopen(path.c_str(), "wb");
+  if (!fp) {
+    std::cerr << "Failed to open " << path << "\n";
+    fail("cannot create output");
+    return false;
+  }
+  if (sized && size > 0 && ftruncate(fileno(fp), size) != 0)
+    std::cerr << "Could not preallocate " << path << "\n";
+  fclose(fp);
+
+  writer = std::make_unique<AlignedWriter>(DiskPipeline::get());
+  if (!writer->open(path, 0)) {
+    writer.reset();
+    fail("cannot open output");
+    return false;
+  }
+  crcSoFar = crc32(0, Z_NULL, 0);
+  sha256ContextCreate(&sha);
+  return true;
+}
+
+void ZipExtractor::hashOutput(const char* p, size_t n) {
+  crcSoFar = crc32(crcSoFar, reinterpret_cast<const Bytef*>(p), n);
+  sha256ContextUpdate(&sha, p, n);
+}
+
+bool ZipExtractor::flush() {
+  if (outFill == 0 || !writer)
+    return true;
+  switch (writer->write(out.get(), outFill)) {
+  case WriteResult::Ok:
+    outFill = 0;
+    return true;
+  case WriteResult::Full:
+    return false;
+  case WriteResult::Error:
+    // Callers see the failed state; nothing more is written.
+    outFill = 0;
+    fail("write error");
+    return true;
+  }
+  return true;
+}
+
+bool ZipExtractor::takeStored(size_t& avail) {
+  while (consumed < compressedSize) {
+    if (avail == 0 || state == State::Failed)
+      return false;
+    size_t take = avail;
+    if (take > compressedSize - consumed)
+      take = compressedSize - consumed;
+    if (wanted) {
+      if (outFill == kOutputSize && !flush()) {
+        blocked = true;
+        return false;
+      }
+      if (take > kOutputSize - outFill)
+        take = kOutputSize - outFill;
+      memcpy(out.get() + outFill, input.data() + pos, take);
+      hashOutput(out.get() + outFill, take);
+      outFill += take;
+      produced += take;
+    }
+    pos += take;
+    consumed += take;
+    avail -= take;
+  }
+  return true;
+}
+
+bool ZipExtractor::takeDeflated(size_t& avail) {
+  for (;;) {
+    if (wanted && outFill == kOutputSize && !flush()) {
+      blocked = true;
+      return false;
+    }
+    if (state == State::Failed)
+      return false;
+
+    size_t in = avail;
+    // With known sizes the stream must not run into the next header.
+    if (!(flags & kFlagDescriptor) && in > compressedSize - consumed)
+      in = compressedSize - consumed;
+    size_t room = kOutputSize - outFill;
+    zs.next_in = reinterpret_cast<Bytef*>(&input[pos]);
+    zs.avail_in = in;
+    zs.next_out = reinterpret_cast<Bytef*>(out.get() + outFill);
+    zs.avail_out = room;
+    int rc = inflate(&zs, Z_NO_FLUSH);
+
+    size_t used = in - zs.avail_in;
+    size_t made = room - zs.avail_out;
+    pos += used;
+    consumed += used;
+    avail -= used;
+    produced += made;
+    // Skipped entries are inflated into the same buffer and dropped.
+    if (wanted) {
+      hashOutput(out.get() + outFill, made);
+      outFill += made;
+    }
+
+    if (rc == Z_STREAM_END) {
+      inflateEnd(&zs);
+      inflating = false;
+      return true;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) {
+      fail("corrupt deflate stream");
+      return false;
+    }
+    if (used == 0 && made == 0)
+      return false; // wants more input
+  }
+}
+
+bool ZipExtractor::closeEntry() {
+  if (!wanted)
+    return true;
+  if (!flush()) {
+    blocked = true;
+    return false;
+  }
+  bool ok = writer->close();
+  writer.reset();
+  if (!ok) {
+    fail("write error");
+    return false;
+  }
+  if ((uint32_t)crcSoFar != crc || produced != size) {
+    std::cerr << "Bad CRC or size for " << name << "\n";
+    remove(path.c_str());
+    fail("archive is damaged");
+    return false;
+  }
+  written.push_back({name, path, digestHex(sha), produced});
+  return true;
+}
+
+bool ZipExtractor::finish() {
+  // The pool drains on the disk thread; wait for it to take the rest.
+  while (blocked && state != State::Failed) {
+    if (flush()) {
+      blocked = false;
+      process();
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  if (state == State::Failed)
+    return false;
+  if (state != State::Trailer) {
+    fail("archive is truncated");
+    return false;
+  }
+  return true;
+}
+
+void ZipExtractor::discard() {
+  if (writer) {
+    writer->close();
+    writer.reset();
+    remove(path.c_str());
+  }
+  for (auto& f : written)
+    remove(f.path.c_str());
+  written.clear();
+}
@@ -0,0 +1,104 @@
+#ifndef UNZIP_H
+#define UNZIP_H
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sha256.h"
+#include "writer.h"
+
+// -------------------- Streaming Zip Extraction --------------------
+
+// Unpacks a zip archive from its bytes in order, as a download delivers
+// them, so the archive itself never reaches the SD card. Entries whose names
+// end in one of the wanted suffixes are inflated into files through the
+// DiskPipeline; everything else is skipped over. Each file's CRC-32 is
+// checked against the archive and its SHA-256 computed on the way out.
+//
+// Entries are found through their local headers, not the central directory
+// at the end, so sizes may come after the data (data descriptors, as
+// GitLab's runner writes them) for deflated entries.
+class ZipExtractor {
+public:
+  struct File {
+    std::string name; // path inside the archive
+    std::string path; // where it was written
+    std::string sha256;
+    uint64_t size = 0;
+  };
+
+  // Files are written to `pathPrefix` followed by the entry's base name.
+  ZipExtractor(std::string pathPrefix, std::vector<std::string> suffixes);
+  ~ZipExtractor();
+
+  ZipExtractor(const ZipExtractor&) = delete;
+  ZipExtractor& operator=(const ZipExtractor&) = delete;
+
+  // Same contract as AlignedWriter::write(): Full means nothing was taken
+  // and the same bytes must be offered again later.
+  WriteResult write(const char* data, size_t n);
+
+  // Writes out the last file and waits for it; false when the archive was
+  // malformed or cut short.
+  bool finish();
+
+  // Deletes every file written so far.
+  void discard();
+
+  const std::vector<File>& files() const { return written; }
+
+private:
+  enum class State { Signature, Header, Data, Descriptor, Closing, Trailer,
+                     Failed };
+
+  void process();
+  bool beginEntry(const char* header, size_t nameLen, size_t extraLen);
+  bool isWritten(const std::string& path) const;
+  bool takeStored(size_t& avail);
+  bool takeDeflated(size_t& avail);
+  bool closeEntry();
+  void hashOutput(const char* p, size_t n);
+  bool flush();
+  void fail(const char* why);
+
+  std::string prefix;
+  std::vector<std::string> suffixes;
+  State state = State::Signature;
+
+  // Bytes received but not parsed yet; at most one caller chunk plus a
+  // header while the output is blocked.
+  std::string input;
+  size_t pos = 0;
+  // A full output buffer the pool had no room for; input is refused until
+  // it is written.
+  bool blocked = false;
+
+  // Entry being read.
+  std::string name;
+  uint16_t flags = 0;
+  uint16_t method = 0;
+  uint32_t crc = 0;
+  uint64_t compressedSize = 0;
+  uint64_t size = 0;
+  bool zip64 = false;
+  bool wanted = false;
+  uint64_t consumed = 0;
+  uint64_t produced = 0;
+  z_stream zs;
+  bool inflating = false;
+  uLong crcSoFar = 0;
+  Sha256Context sha;
+  std::string path;
+  std::unique_ptr<AlignedWriter> writer;
+
+  std::unique_ptr<char[]> out;
+  size_t outFill = 0;
+
+  std::vector<File> written;
+};
+
+#endif // UNZIP_H
@@ -0,0 +1,252 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "platform.h"
+#include "writer.h"
+
+// Alignment of the buffers themselves; page-aligned memory lets the
+// filesystem service map it without bouncing.
+static const size_t kBufferAlign = 0x1000;
+
+// -------------------- Buffer Pool --------------------
+
+BufferPool::BufferPool(size_t bufferSize, size_t count) : size(bufferSize) {
+  size_t allocSize = (size + kBufferAlign - 1) / kBufferAlign * kBufferAlign;
+  for (size_t i = 0; i < count; ++i) {
+    char* buf = static_cast<char*>(aligned_alloc(kBufferAlign, allocSize));
+    if (!buf) {
+      std::cerr << "Out of memory for write buffers\n";
+      break;
+    }
+    all.push_back(buf);
+    freeList.push_back(buf);
+  }
+}
+
+BufferPool::~BufferPool() {
+  for (char* buf : all)
+    free(buf);
+}
+
+char* BufferPool::tryAcquire() {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (freeList.empty())
+    return nullptr;
+  char* buf = freeList.back();
+  freeList.pop_back();
+  return buf;
+}
+
+void BufferPool::release(char* buffer) {
+  std::lock_guard<std::mutex> lock(mtx);
+  freeList.push_back(buffer);
+  for (auto& l : listeners)
+    l.second();
+}
+
+int BufferPool::addListener(std::function<void()> fn) {
+  std::lock_guard<std::mutex> lock(mtx);
+  int id = nextListener++;
+  listeners.emplace_back(id, std::move(fn));
+  return id;
+}
+
+void BufferPool::removeListener(int id) {
+  std::lock_guard<std::mutex> lock(mtx);
+  for (size_t i = 0; i < listeners.size(); ++i) {
+    if (listeners[i].first == id) {
+      listeners.erase(listeners.begin() + i);
+      break;
+    }
+  }
+}
+
+// -------------------- Disk Pipeline --------------------
+
+static WriterConfig pipelineConfig;
+
+void DiskPipeline::configure(const WriterConfig& config) {
+  pipelineConfig = config;
+}
+
+DiskPipeline& DiskPipeline::get() {
+  static DiskPipeline pipeline(pipelineConfig);
+  return pipeline;
+}
+
+DiskPipeline::DiskPipeline(const WriterConfig& config)
+    : buffers(config.bufferSize, config.bufferCount),
+      cluster(config.clusterSize ? config.clusterSize : 1),
+      worker([this]() { run(); }) {}
+
+DiskPipeline::~DiskPipeline() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  cv.notify_all();
+  worker.join();
+}
+
+void DiskPipeline::submit(int fd, off_t offset, char* buffer, size_t len,
+                          std::function<void(bool)> done) {
+  ++queued;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    jobs.push_back({fd, offset, buffer, len, std::move(done)});
+  }
+  cv.notify_one();
+}
+
+void DiskPipeline::run() {
+  pinCurrentThreadToCore(kDiskCore);
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty())
+        return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    bool ok = lseek(job.fd, job.offset, SEEK_SET) == job.offset;
+    size_t off = 0;
+    while (ok && off < job.len) {
+      ssize_t n = ::write(job.fd, job.buffer + off, job.len - off);
+      if (n <= 0)
+        ok = false;
+      else
+        off += n;
+    }
+    latency.record(std::chrono::steady_clock::now() - started);
+    job.done(ok);
+    --queued;
+    buffers.release(job.buffer);
+  }
+}
+
+// -------------------- Aligned Writer --------------------
+
+AlignedWriter::AlignedWriter(DiskPipeline& pipeline)
+    : pipeline(pipeline), bufferSize(pipeline.pool().bufferSize()),
+      clusterSize(pipeline.clusterSize()) {
+  // Buffers smaller than a cluster cannot be aligned; flush them whole.
+  if (clusterSize > bufferSize)
+    clusterSize = bufferSize;
+}
+
+AlignedWriter::~AlignedWriter() {
+  close();
+}
+
+bool AlignedWriter::open(const std::string& path, off_t offset) {
+  fd = ::open(path.c_str(), O_WRONLY);
+  if (fd < 0)
+    return false;
+  nextOffset = offset;
+  fill = 0;
+  return true;
+}
+
+size_t AlignedWriter::capacity() const {
+  size_t cap = active ? target - fill : 0;
+  off_t off = nextOffset + (active ? target : 0);
+  for (size_t i = 0; i < spare.size(); ++i) {
+    size_t t = bufferSize - off % clusterSize;
+    cap += t;
+    off += t;
+  }
+  return cap;
+}
+
+WriteResult AlignedWriter::write(const char* data, size_t n) {
+  if (failed || fd < 0)
+    return WriteResult::Error;
+
+  while (capacity() < n) {
+    char* buf = pipeline.pool().tryAcquire();
+    if (!buf) {
+      // Buffers queued for the disk will come back and wake us. If none
+      // are queued, every buffer sits half-full in some writer; hand ours
+      // over early or they would wait on each other forever.
+      if (active && fill > 0 && pipeline.pending() == 0)
+        submitActive();
+      return WriteResult::Full;
+    }
+    spare.push_back(buf);
+  }
+
+  while (n > 0) {
+    if (!active) {
+      active = spare.front();
+      spare.pop_front();
+      fill = 0;
+      // Cut the buffer short when needed so the next one starts on a
+      // cluster boundary.
+      target = bufferSize - nextOffset % clusterSize;
+    }
+    size_t chunk = target - fill;
+    if (chunk > n)
+      chunk = n;
+    memcpy(active + fill, data, chunk);
+    fill += chunk;
+    data += chunk;
+    n -= chunk;
+    if (fill == target)
+      submitActive();
+  }
+  return failed ? WriteResult::Error : WriteResult::Ok;
+}
+
+bool AlignedWriter::close() {
+  if (fd < 0)
+    return !failed;
+  if (active && fill > 0)
+    submitActive();
+  if (active)
+    pipeline.pool().release(active);
+  active = nullptr;
+  for (char* buf : spare)
+    pipeline.pool().release(buf);
+  spare.clear();
+
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this]() { return inFlight == 0; });
+  }
+  ::close(fd);
+  fd = -1;
+  return !failed;
+}
+
+void AlignedWriter::submitActive() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    ++inFlight;
+  }
+
+  size_t len = fill;
+  pipeline.submit(fd, nextOffset, active, len, [this, len](bool ok) {
+    // After a failure nothing later counts: the durable prefix has a gap.
+    if (ok && !failed)
+      flushed += len;
+    else
+      failed = true;
+    // Notify under the lock: close() may destroy us as soon as it sees
+    // inFlight reach zero.
+    std::lock_guard<std::mutex> lock(mtx);
+    --inFlight;
+    cv.notify_all();
+  });
+
+  nextOffset += len;
+  active = nullptr;
+  fill = 0;
+}
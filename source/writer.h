@@ -0,0 +1,159 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "metrics.h"
+
+// -------------------- Download Write Pipeline --------------------
+//
+// Network callbacks copy bytes into fixed-size buffers taken from one
+// shared pool; a dedicated disk thread, pinned to its own core, writes the
+// full buffers out and returns them to the pool. Memory use is therefore
+// bounded by the pool: when it is empty the writer reports Full and the
+// caller pauses its transfer until a buffer comes back.
+
+struct WriterConfig {
+  // Size of each pool buffer; large sequential writes are what the SD card
+  // is fast at.
+  size_t bufferSize = 1024 * 1024;
+  size_t bufferCount = 8;
+  // Full buffers are flushed so they end on a multiple of this, which keeps
+  // writes after the first one cluster-aligned in the file.
+  size_t clusterSize = 128 * 1024;
+};
+
+class BufferPool {
+public:
+  BufferPool(size_t bufferSize, size_t count);
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // Returns nullptr when every buffer is in use.
+  char* tryAcquire();
+  void release(char* buffer);
+
+  // Listeners run (on the releasing thread) whenever a buffer comes back,
+  // so paused transfers can be woken up.
+  int addListener(std::function<void()> fn);
+  void removeListener(int id);
+
+  size_t bufferSize() const { return size; }
+
+private:
+  size_t size;
+  std::vector<char*> all;
+  std::vector<char*> freeList;
+  std::vector<std::pair<int, std::function<void()>>> listeners;
+  int nextListener = 1;
+  std::mutex mtx;
+};
+
+class DiskPipeline {
+public:
+  // Must be called before the first get() to take effect.
+  static void configure(const WriterConfig& config);
+  static DiskPipeline& get();
+
+  ~DiskPipeline();
+
+  BufferPool& pool() { return buffers; }
+  size_t clusterSize() const { return cluster; }
+  // Buffers submitted but not yet returned to the pool.
+  int pending() const { return queued; }
+  // How long each buffer took to write, seek included.
+  const LatencyHistogram& writeLatency() const { return latency; }
+
+  // Writes `len` bytes of `buffer` at `offset` of `fd` on the disk thread,
+  // calls `done` there with the outcome and then returns `buffer` to the
+  // pool.
+  void submit(int fd, off_t offset, char* buffer, size_t len,
+              std::function<void(bool)> done);
+
+private:
+  explicit DiskPipeline(const WriterConfig& config);
+
+  struct Job {
+    int fd;
+    off_t offset;
+    char* buffer;
+    size_t len;
+    std::function<void(bool)> done;
+  };
+
+  void run();
+
+  BufferPool buffers;
+  size_t cluster;
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<Job> jobs;
+  bool stopping = false;
+  std::atomic<int> queued{0};
+  LatencyHistogram latency;
+  std::thread worker;
+};
+
+enum class WriteResult { Ok, Full, Error };
+
+// Appends to a (preallocated) file from a given offset through buffers of
+// the DiskPipeline pool. Only one thread may call write()/close().
+class AlignedWriter {
+public:
+  explicit AlignedWriter(DiskPipeline& pipeline);
+  ~AlignedWriter();
+
+  AlignedWriter(const AlignedWriter&) = delete;
+  AlignedWriter& operator=(const AlignedWriter&) = delete;
+
+  bool open(const std::string& path, off_t offset);
+
+  // Takes all `n` bytes or none of them: Full means the pool is exhausted
+  // and the same bytes must be offered again later.
+  WriteResult write(const char* data, size_t n);
+
+  // Writes out whatever is buffered, waits for it and closes the file.
+  bool close();
+
+  // Bytes that have reached the file, counted from the open() offset.
+  int64_t flushedBytes() const { return flushed; }
+  bool hasFailed() const { return failed; }
+
+private:
+  size_t capacity() const;
+  void submitActive();
+
+  DiskPipeline& pipeline;
+  size_t bufferSize;
+  size_t clusterSize;
+
+  int fd = -1;
+  off_t nextOffset = 0;
+  char* active = nullptr;
+  size_t fill = 0;
+  size_t target = 0;
+  std::deque<char*> spare;
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  int inFlight = 0;
+  std::atomic<int64_t> flushed{0};
+  std::atomic<bool> failed{false};
+};
+
+#endif // WRITER_H